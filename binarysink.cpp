@@ -0,0 +1,240 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "binarysink.h"
+#include "mainwindow.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QtEndian>
+#include <string.h>
+
+
+#define BINARY_FORMAT_VERSION 1
+#define BINARY_BLOCK_POINTS   4096 // Points of a full block
+#define BINARY_COLUMNS        6
+
+
+// Little endian, whatever the host
+static inline char*
+putDouble(char *p, double value) {
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    qToLittleEndian(bits, reinterpret_cast<uchar*>(p));
+    return p + sizeof(bits);
+}
+
+
+BinarySink::BinarySink()
+    : pFile(nullptr)
+{
+}
+
+
+BinarySink::~BinarySink() {
+    delete pFile;
+}
+
+
+bool
+BinarySink::openRun(const RunInfo &info) {
+    QFileInfo fileInfo(info.sFileName);
+    pFile = new QFile(QString("%1/%2.gfr").arg(info.sBaseDir, fileInfo.baseName()));
+    if(!pFile->open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+        sError = QString("Unable to Open Output File %1").arg(pFile->fileName());
+        return false;
+    }
+    QByteArray sText = headerText(info);
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData("GFETRUN1", 8);
+    stream << quint32(BINARY_FORMAT_VERSION)
+           << quint32(sText.size());
+    stream.writeRawData(sText.constData(), sText.size());
+    stream << crc32(sText.constData(), sText.size());
+    return writeBytes(header);
+}
+
+
+// A step written again replaces the previous data
+bool
+BinarySink::openStep(int iStep, double stepValue) {
+    for(int i=index.count()-1; i>=0; i--) {
+        if(index.at(i).step == iStep)
+            index.remove(i);
+    }
+    StepData &data = openSteps[iStep];
+    data.stepValue = stepValue;
+    data.points.resize(0);
+    return true;
+}
+
+
+bool
+BinarySink::write(int iStep, const RunPoint *pPoints, int nPoints) {
+    if(!openSteps.contains(iStep)) {
+        sError = QString("Step %1 of %2 not Open").arg(iStep).arg(pFile->fileName());
+        return false;
+    }
+    StepData &data = openSteps[iStep];
+    for(int i=0; i<nPoints; i++) {
+        data.points.append(pPoints[i]);
+        if(data.points.count() >= BINARY_BLOCK_POINTS) {
+            if(!writeBlock(iStep, data))
+                return false;
+        }
+    }
+    return true;
+}
+
+
+// Only full blocks are written as the points come (see write()):
+// a flush pushes them to the disk, the points of the open steps
+// become a block when the step (or the run) is closed
+bool
+BinarySink::flush(bool bSync) {
+    if(!(bSync ? syncFile(pFile) : pFile->flush())) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+bool
+BinarySink::closeStep(int iStep, bool bSync) {
+    if(!openSteps.contains(iStep))
+        return true;
+    if(!writeBlock(iStep, openSteps[iStep]))
+        return false;
+    openSteps.remove(iStep);
+    if(!(bSync ? syncFile(pFile) : pFile->flush())) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+bool
+BinarySink::closeRun() {
+    if(!pFile || !pFile->isOpen())
+        return true;
+    QMap<int, StepData>::iterator it;
+    for(it=openSteps.begin(); it!=openSteps.end(); ++it) {
+        if(!writeBlock(it.key(), it.value()))
+            return false;
+    }
+    openSteps.clear();
+    if(!writeIndex())
+        return false;
+    pFile->close();
+    return true;
+}
+
+
+QByteArray
+BinarySink::headerText(const RunInfo &info) const {
+    QStringList lines;
+    lines << "Format=gfet binary run"
+          << "Columns=V_G[V]:f64,I_G[A]:f64,V_DS[V]:f64,I_DS[A]:f64,T[ns]:i64,N_RDG:i32"
+          << QString("Measure=%1").arg(info.iMeasure == MainWindow::Rds_vs_Vg ? "Rds_vs_Vg" : "IdsVds_vs_Vg")
+          << QString("StepVariable=%1").arg(info.iMeasure == MainWindow::Rds_vs_Vg ? "V_DS[V]" : "V_G[V]")
+          << QString("StartTime=%1").arg(info.startTime.toString(Qt::ISODate));
+    QStringList sampleLines = info.sSampleInfo.split("\n");
+    for(int i=0; i<sampleLines.count(); i++)
+        lines << QString("SampleInfo=%1").arg(sampleLines.at(i));
+    lines << info.parameters;
+    return (lines.join("\n") + "\n").toUtf8();
+}
+
+
+// The points of the step still in memory (if any) in a block
+bool
+BinarySink::writeBlock(int iStep, StepData &data) {
+    int nPoints = data.points.count();
+    if(nPoints == 0)
+        return true;
+    const RunPoint *pPoints = data.points.constData();
+    int dataSize = nPoints*(4*sizeof(double) + sizeof(qint64) + sizeof(qint32));
+    block.resize(28 + dataSize);
+    char *pData = block.data() + 28;
+    char *p = pData;
+    for(int i=0; i<nPoints; i++) p = putDouble(p, pPoints[i].vg);
+    for(int i=0; i<nPoints; i++) p = putDouble(p, pPoints[i].ig);
+    for(int i=0; i<nPoints; i++) p = putDouble(p, pPoints[i].vds);
+    for(int i=0; i<nPoints; i++) p = putDouble(p, pPoints[i].ids);
+    for(int i=0; i<nPoints; i++, p+=8)
+        qToLittleEndian(pPoints[i].timestamp, reinterpret_cast<uchar*>(p));
+    for(int i=0; i<nPoints; i++, p+=4)
+        qToLittleEndian(pPoints[i].nReadings, reinterpret_cast<uchar*>(p));
+    uchar *pHeader = reinterpret_cast<uchar*>(block.data());
+    memcpy(pHeader, "GBLK", 4);
+    qToLittleEndian(qint32(iStep), pHeader+4);
+    putDouble(block.data()+8, data.stepValue);
+    qToLittleEndian(quint32(nPoints), pHeader+16);
+    qToLittleEndian(quint32(BINARY_COLUMNS), pHeader+20);
+    qToLittleEndian(crc32(pData, dataSize), pHeader+24);
+    IndexEntry entry;
+    entry.step      = iStep;
+    entry.stepValue = data.stepValue;
+    entry.offset    = quint64(pFile->pos());
+    entry.points    = quint32(nPoints);
+    if(!writeBytes(block))
+        return false;
+    index.append(entry);
+    data.points.resize(0);
+    return true;
+}
+
+
+bool
+BinarySink::writeIndex() {
+    QByteArray entries;
+    QDataStream stream(&entries, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+    for(int i=0; i<index.count(); i++)
+        stream << index.at(i).step
+               << index.at(i).stepValue
+               << index.at(i).offset
+               << index.at(i).points;
+    quint64 indexOffset = quint64(pFile->pos());
+    QByteArray tail;
+    QDataStream tailStream(&tail, QIODevice::WriteOnly);
+    tailStream.setByteOrder(QDataStream::LittleEndian);
+    tailStream.writeRawData("GIDX", 4);
+    tailStream << quint32(index.count());
+    tailStream.writeRawData(entries.constData(), entries.size());
+    tailStream << crc32(entries.constData(), entries.size())
+               << indexOffset;
+    tailStream.writeRawData("GFETEND1", 8);
+    return writeBytes(tail) && pFile->flush();
+}
+
+
+bool
+BinarySink::writeBytes(const QByteArray &data) {
+    if(pFile->write(data) != data.size()) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
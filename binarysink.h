@@ -0,0 +1,84 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include "runwriter.h"
+
+#include <QMap>
+#include <QByteArray>
+
+
+// A compact, self describing binary file for the whole run,
+// <name>.gfr, written along with the text files.
+// All the numbers are little endian.
+//
+// Header: "GFETRUN1", quint32 version, quint32 text size, the UTF-8
+//         text ("Name=Value" lines: columns, sample information and
+//         configuration), quint32 CRC-32 of the text
+// Block:  "GBLK", qint32 step, double step value (Vg or Vds),
+//         quint32 points, quint32 columns, quint32 CRC-32 of the data,
+//         then the data, a column after the other:
+//         V_G, I_G, V_DS, I_DS (double), T [ns] (qint64), N_RDG (qint32)
+// Index:  "GIDX", quint32 entries, for each block: qint32 step,
+//         double step value, quint64 block offset, quint32 points;
+//         quint32 CRC-32 of the entries
+// Trailer: quint64 index offset, "GFETEND1"
+//
+// A step has one or more blocks, all of 4096 points
+// but the last one (written when the step is closed: the journal is
+// the crash safe record of the run); the blocks of a step written again
+// (a repeated sweep) are left in the file but not in the index.
+class BinarySink : public RunSink
+{
+public:
+    BinarySink();
+    ~BinarySink();
+
+public:
+    bool openRun(const RunInfo &info);
+    bool openStep(int iStep, double stepValue);
+    bool write(int iStep, const RunPoint *pPoints, int nPoints);
+    bool flush(bool bSync);
+    bool closeStep(int iStep, bool bSync);
+    bool closeRun();
+
+private:
+    struct IndexEntry {
+        qint32  step;
+        double  stepValue;
+        quint64 offset;
+        quint32 points;
+    };
+    struct StepData {
+        double            stepValue;
+        QVector<RunPoint> points; // Not yet written
+    };
+
+private:
+    QByteArray headerText(const RunInfo &info) const;
+    bool       writeBlock(int iStep, StepData &data);
+    bool       writeIndex();
+    bool       writeBytes(const QByteArray &data);
+
+private:
+    QFile                  *pFile;
+    QMap<int, StepData>     openSteps;
+    QVector<IndexEntry>     index;
+    QByteArray              block;
+};
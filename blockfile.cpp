@@ -0,0 +1,355 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "blockfile.h"
+
+#include <QtEndian>
+#include <string.h>
+
+
+#define BLOCK_FILE_MAGIC   "GFETBLK1"
+#define BLOCK_FRAME_HEADER 20 // "GBZF", offset, size, compressed size
+#define BLOCK_INDEX_ENTRY  24
+#define BLOCK_TRAILER      16 // Index offset, "GBZEND01"
+
+
+BlockFileWriter::BlockFileWriter()
+    : pFile(nullptr)
+    , streamPos(0)
+{
+}
+
+
+// The file must be open for reading and writing. When appending,
+// the index of a complete file (or whatever follows the last whole
+// block of a broken one) is replaced by the new blocks
+bool
+BlockFileWriter::open(QFile *pFile, bool bAppend) {
+    this->pFile = pFile;
+    pending.resize(0);
+    frames.clear();
+    streamPos = 0;
+    if(bAppend && (pFile->size() > 0)) {
+        BlockFileReader reader;
+        if(!reader.open(pFile->fileName())) {
+            sError = reader.errorString();
+            return false;
+        }
+        frames    = reader.blocks();
+        streamPos = reader.size();
+        qint64 end = reader.blocksEnd();
+        reader.close();
+        if(!pFile->resize(end) || !pFile->seek(end)) {
+            sError = QString("Unable to Write %1").arg(pFile->fileName());
+            return false;
+        }
+        return true;
+    }
+    if(!pFile->resize(0))  {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return writeBytes(QByteArray(BLOCK_FILE_MAGIC));
+}
+
+
+bool
+BlockFileWriter::write(const QByteArray &data) {
+    pending.append(data);
+    while(pending.size() >= blockSize) {
+        if(!writeBlock())
+            return false;
+    }
+    return true;
+}
+
+
+// The pending bytes become a (short) block
+bool
+BlockFileWriter::flush() {
+    if(!pending.isEmpty() && !writeBlock())
+        return false;
+    if(!pFile->flush()) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+bool
+BlockFileWriter::close() {
+    if(!pending.isEmpty() && !writeBlock())
+        return false;
+    QByteArray index(4+4+frames.count()*BLOCK_INDEX_ENTRY+BLOCK_TRAILER, 0);
+    char *p = index.data();
+    memcpy(p, "GBZI", 4);
+    qToLittleEndian(quint32(frames.count()), reinterpret_cast<uchar*>(p+4));
+    p += 8;
+    for(int i=0; i<frames.count(); i++) {
+        qToLittleEndian(frames.at(i).offset,     reinterpret_cast<uchar*>(p));
+        qToLittleEndian(frames.at(i).size,       reinterpret_cast<uchar*>(p+8));
+        qToLittleEndian(frames.at(i).fileOffset, reinterpret_cast<uchar*>(p+12));
+        qToLittleEndian(frames.at(i).packedSize, reinterpret_cast<uchar*>(p+20));
+        p += BLOCK_INDEX_ENTRY;
+    }
+    qToLittleEndian(pFile->pos(), reinterpret_cast<uchar*>(p));
+    memcpy(p+8, "GBZEND01", 8);
+    return writeBytes(index) && pFile->flush();
+}
+
+
+// Position in the stream
+qint64
+BlockFileWriter::pos() const {
+    return streamPos + pending.size();
+}
+
+
+QString
+BlockFileWriter::errorString() const {
+    return sError;
+}
+
+
+bool
+BlockFileWriter::writeBlock() {
+    int nBytes = qMin(pending.size(), blockSize);
+    QByteArray packed = qCompress(reinterpret_cast<const uchar*>(pending.constData()), nBytes);
+    QByteArray header(BLOCK_FRAME_HEADER, 0);
+    char *p = header.data();
+    memcpy(p, "GBZF", 4);
+    qToLittleEndian(streamPos,              reinterpret_cast<uchar*>(p+4));
+    qToLittleEndian(quint32(nBytes),        reinterpret_cast<uchar*>(p+12));
+    qToLittleEndian(quint32(packed.size()), reinterpret_cast<uchar*>(p+16));
+    BlockFrame frame;
+    frame.offset     = streamPos;
+    frame.size       = quint32(nBytes);
+    frame.fileOffset = pFile->pos() + BLOCK_FRAME_HEADER;
+    frame.packedSize = quint32(packed.size());
+    if(!writeBytes(header + packed))
+        return false;
+    frames.append(frame);
+    streamPos += nBytes;
+    pending.remove(0, nBytes);
+    return true;
+}
+
+
+bool
+BlockFileWriter::writeBytes(const QByteArray &data) {
+    if(pFile->write(data) != data.size()) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+BlockFileReader::BlockFileReader()
+    : bIndexed(false)
+    , endOfBlocks(0)
+    , cachedBlock(-1)
+{
+}
+
+
+bool
+BlockFileReader::isBlockFile(const QString &sFileName) {
+    QFile file(sFileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    return file.read(8) == BLOCK_FILE_MAGIC;
+}
+
+
+bool
+BlockFileReader::open(const QString &sFileName) {
+    close();
+    file.setFileName(sFileName);
+    if(!file.open(QIODevice::ReadOnly)) {
+        sError = QString("Unable to Open %1").arg(sFileName);
+        return false;
+    }
+    if(file.read(8) != BLOCK_FILE_MAGIC) {
+        sError = QString("%1 is not a Block Compressed File").arg(sFileName);
+        file.close();
+        return false;
+    }
+    bIndexed = readIndex();
+    if(!bIndexed)
+        scanBlocks();
+    return true;
+}
+
+
+void
+BlockFileReader::close() {
+    if(file.isOpen())
+        file.close();
+    frames.clear();
+    bIndexed    = false;
+    endOfBlocks = 0;
+    cachedBlock = -1;
+    cachedData.clear();
+}
+
+
+// Bytes in the stream
+qint64
+BlockFileReader::size() const {
+    if(frames.isEmpty())
+        return 0;
+    return frames.last().offset + frames.last().size;
+}
+
+
+// Only the blocks holding the bytes are decompressed
+QByteArray
+BlockFileReader::read(qint64 offset, qint64 nBytes) {
+    QByteArray data;
+    nBytes = qMin(nBytes, size()-offset);
+    if((offset < 0) || (nBytes <= 0))
+        return data;
+    int lo = 0;
+    int hi = frames.count()-1;
+    while(lo < hi) { // The last block starting at or before offset
+        int mid = (lo+hi+1)/2;
+        if(frames.at(mid).offset <= offset)
+            lo = mid;
+        else
+            hi = mid-1;
+    }
+    for(int i=lo; (i<frames.count()) && (data.size()<nBytes); i++) {
+        if(!loadBlock(i))
+            break;
+        qint64 from = qMax(qint64(0), offset-frames.at(i).offset);
+        data.append(cachedData.mid(int(from), int(nBytes-data.size())));
+    }
+    return data;
+}
+
+
+QByteArray
+BlockFileReader::readAll() {
+    return read(0, size());
+}
+
+
+// Written with its index (closed properly)
+bool
+BlockFileReader::isIndexed() const {
+    return bIndexed;
+}
+
+
+qint64
+BlockFileReader::blocksEnd() const {
+    return endOfBlocks;
+}
+
+
+const QVector<BlockFrame>&
+BlockFileReader::blocks() const {
+    return frames;
+}
+
+
+QString
+BlockFileReader::errorString() const {
+    return sError;
+}
+
+
+bool
+BlockFileReader::readIndex() {
+    qint64 fileSize = file.size();
+    if(fileSize < 8+8+BLOCK_TRAILER)
+        return false;
+    file.seek(fileSize-BLOCK_TRAILER);
+    QByteArray trailer = file.read(BLOCK_TRAILER);
+    if(trailer.mid(8) != "GBZEND01")
+        return false;
+    qint64 indexOffset = qFromLittleEndian<qint64>(reinterpret_cast<const uchar*>(trailer.constData()));
+    if((indexOffset < 8) || (indexOffset > fileSize-BLOCK_TRAILER-8))
+        return false;
+    file.seek(indexOffset);
+    QByteArray index = file.read(fileSize-BLOCK_TRAILER-indexOffset);
+    const uchar *p = reinterpret_cast<const uchar*>(index.constData());
+    quint32 nBlocks = qFromLittleEndian<quint32>(p+4);
+    if(!index.startsWith("GBZI") || (index.size() != int(8+nBlocks*BLOCK_INDEX_ENTRY)))
+        return false;
+    p += 8;
+    for(quint32 i=0; i<nBlocks; i++) {
+        BlockFrame frame;
+        frame.offset     = qFromLittleEndian<qint64>(p);
+        frame.size       = qFromLittleEndian<quint32>(p+8);
+        frame.fileOffset = qFromLittleEndian<qint64>(p+12);
+        frame.packedSize = qFromLittleEndian<quint32>(p+20);
+        frames.append(frame);
+        p += BLOCK_INDEX_ENTRY;
+    }
+    endOfBlocks = indexOffset;
+    return true;
+}
+
+
+// The blocks one after the other, up to the first incomplete one
+void
+BlockFileReader::scanBlocks() {
+    frames.clear();
+    qint64 fileSize = file.size();
+    qint64 pos = 8;
+    qint64 streamPos = 0;
+    while(pos+BLOCK_FRAME_HEADER <= fileSize) {
+        file.seek(pos);
+        QByteArray header = file.read(BLOCK_FRAME_HEADER);
+        if(!header.startsWith("GBZF"))
+            break;
+        const uchar *p = reinterpret_cast<const uchar*>(header.constData());
+        BlockFrame frame;
+        frame.offset     = qFromLittleEndian<qint64>(p+4);
+        frame.size       = qFromLittleEndian<quint32>(p+12);
+        frame.packedSize = qFromLittleEndian<quint32>(p+16);
+        frame.fileOffset = pos + BLOCK_FRAME_HEADER;
+        if((frame.offset != streamPos) ||
+           (frame.fileOffset+frame.packedSize > fileSize))
+            break;
+        frames.append(frame);
+        streamPos += frame.size;
+        pos = frame.fileOffset + frame.packedSize;
+    }
+    endOfBlocks = pos;
+}
+
+
+bool
+BlockFileReader::loadBlock(int iBlock) {
+    if(iBlock == cachedBlock)
+        return true;
+    const BlockFrame &frame = frames.at(iBlock);
+    file.seek(frame.fileOffset);
+    cachedData = qUncompress(file.read(frame.packedSize));
+    if(cachedData.size() != int(frame.size)) {
+        sError = QString("Corrupted Block at %1 in %2").arg(frame.fileOffset).arg(file.fileName());
+        cachedBlock = -1;
+        return false;
+    }
+    cachedBlock = iBlock;
+    return true;
+}
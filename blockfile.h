@@ -0,0 +1,112 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QFile>
+
+
+// A stream of bytes stored as independently compressed blocks
+// (zlib, by qCompress), so that any part of it can be read
+// decompressing only the blocks that hold it.
+// All the numbers are little endian.
+//
+// Header:  "GFETBLK1"
+// Block:   "GBZF", qint64 offset of its bytes in the stream,
+//          quint32 bytes, quint32 compressed size, the qCompress data
+//          (zlib checks it with its own Adler-32)
+// Index:   "GBZI", quint32 blocks, for each block: qint64 stream offset,
+//          quint32 bytes, qint64 file offset, quint32 compressed size
+// Trailer: qint64 index offset, "GBZEND01"
+//
+// A file left without index (a crash) is still readable up to its
+// last whole block: the blocks are found scanning the file.
+struct BlockFrame
+{
+    qint64  offset;     // In the stream
+    quint32 size;
+    qint64  fileOffset; // Of the compressed data
+    quint32 packedSize;
+};
+Q_DECLARE_TYPEINFO(BlockFrame, Q_PRIMITIVE_TYPE);
+
+
+class BlockFileWriter
+{
+public:
+    BlockFileWriter();
+
+public:
+    bool    open(QFile *pFile, bool bAppend);
+    bool    write(const QByteArray &data);
+    bool    flush();
+    bool    close();
+    qint64  pos() const;
+    QString errorString() const;
+
+public:
+    static const int blockSize = 65536; // Bytes compressed together
+
+private:
+    bool writeBlock();
+    bool writeBytes(const QByteArray &data);
+
+private:
+    QFile               *pFile;
+    QByteArray           pending;   // Not yet compressed
+    qint64               streamPos; // Of the first pending byte
+    QVector<BlockFrame>  frames;
+    QString              sError;
+};
+
+
+class BlockFileReader
+{
+public:
+    BlockFileReader();
+
+public:
+    bool       open(const QString &sFileName);
+    void       close();
+    qint64     size() const;
+    QByteArray read(qint64 offset, qint64 nBytes);
+    QByteArray readAll();
+    bool       isIndexed() const;
+    qint64     blocksEnd() const;
+    const QVector<BlockFrame> &blocks() const;
+    QString    errorString() const;
+    static bool isBlockFile(const QString &sFileName);
+
+private:
+    bool       readIndex();
+    void       scanBlocks();
+    bool       loadBlock(int iBlock);
+
+private:
+    QFile               file;
+    QVector<BlockFrame> frames;
+    bool                bIndexed;
+    qint64              endOfBlocks; // File offset after the last whole block
+    int                 cachedBlock;
+    QByteArray          cachedData;
+    QString             sError;
+};
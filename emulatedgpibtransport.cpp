@@ -0,0 +1,561 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "emulatedgpibtransport.h"
+
+#include <QThread>
+#include <QMutexLocker>
+#include <string.h>
+
+
+#define FIRST_DEVICE_DESCRIPTOR 16
+#define SRQ_CHECK_TIME          200 // [us]
+
+
+namespace emulatedgpibtransport {
+// Results of the last call, as ThreadIbsta() & co.
+static thread_local int  threadIbsta = 0;
+static thread_local int  threadIberr = 0;
+static thread_local long threadIbcnt = 0;
+
+// The ibdev() timeout codes in microseconds (TNONE = wait forever)
+static const qint64 timeoutTime[18] = {
+    0, 10, 30, 100, 300,
+    1000, 3000, 10000, 30000, 100000, 300000,
+    1000000, 3000000, 10000000, 30000000, 100000000, 300000000,
+    Q_INT64_C(1000000000)
+};
+}
+
+
+EmulatedGpibTransport::EmulatedGpibTransport(int idsAddress, int vgAddress)
+    : busBusyUntil(0)
+{
+    clock.start();
+    instruments.append(new K236Emulator(idsAddress, &sample, false));
+    instruments.append(new K236Emulator(vgAddress,  &sample, true));
+    // The trigger link cable: Vg TRIGGER OUT -> Ids TRIGGER IN
+    instruments.at(1)->setTriggerLink(instruments.at(0));
+}
+
+
+EmulatedGpibTransport::~EmulatedGpibTransport() {
+    qDeleteAll(instruments);
+    instruments.clear();
+}
+
+
+qint64
+EmulatedGpibTransport::now() {
+    return clock.nsecsElapsed() / 1000;
+}
+
+
+K236Emulator*
+EmulatedGpibTransport::instrumentAt(int pad) {
+    for(int i=0; i<instruments.count(); i++) {
+        if(instruments.at(i)->address() == pad)
+            return instruments.at(i);
+    }
+    return nullptr;
+}
+
+
+EmulatedGpibTransport::Device*
+EmulatedGpibTransport::device(int ud) {
+    int i = ud - FIRST_DEVICE_DESCRIPTOR;
+    if((i < 0) || (i >= devices.count()) || !devices.at(i).bOnline)
+        return nullptr;
+    return &devices[i];
+}
+
+
+int
+EmulatedGpibTransport::setResult(int sta, int err, long cnt) {
+    emulatedgpibtransport::threadIbsta = sta;
+    emulatedgpibtransport::threadIberr = err;
+    emulatedgpibtransport::threadIbcnt = cnt;
+    return sta;
+}
+
+
+// The bus is kept busy for the time needed by the handshake
+// (after the end of an asynchronous transfer in progress)
+void
+EmulatedGpibTransport::transferDelay(long nBytes) {
+    qint64 t = now();
+    qint64 tWait = qMax(busBusyUntil-t, qint64(0)) + nBytes*K236Emulator::byteTime;
+    QThread::usleep(ulong(tWait));
+}
+
+
+int
+EmulatedGpibTransport::listenTo(K236Emulator *pInstrument, const char *data, long count) {
+    transferDelay(count);
+    pInstrument->listen(QByteArray(data, int(count)), now());
+    return setResult(CMPL, 0, count);
+}
+
+
+// With bWait false the bytes are taken at once: the caller
+// accounts for the transfer time
+int
+EmulatedGpibTransport::talkFrom(K236Emulator *pInstrument, char *buffer, long count, int timeout,
+                                bool bWait) {
+    QByteArray &pending = talkBuffer[pInstrument->address()];
+    if(pending.isEmpty()) {
+        qint64 tMax = emulatedgpibtransport::timeoutTime[qBound(0, timeout, 17)];
+        qint64 t0 = now();
+        qint64 tReady = pInstrument->dataAvailableAt(t0);
+        if((tReady < 0) || ((tMax > 0) && (tReady-t0 > tMax))) {
+            QThread::usleep(ulong(tMax));
+            return setResult(ERR | TIMO | CMPL, EABO, 0);
+        }
+        if(tReady > t0)
+            QThread::usleep(ulong(tReady - t0));
+        pending = pInstrument->talk(now());
+        if(pending.isEmpty())
+            return setResult(ERR | TIMO | CMPL, EABO, 0);
+    }
+    long nBytes = qMin(count, long(pending.size()));
+    memcpy(buffer, pending.constData(), size_t(nBytes));
+    pending.remove(0, int(nBytes));
+    if(bWait)
+        transferDelay(nBytes);
+    int sta = CMPL;
+    if(pending.isEmpty())
+        sta |= END;
+    return setResult(sta, 0, nBytes);
+}
+
+
+int
+EmulatedGpibTransport::openDevice(int board, int pad, int sad, int tmo, int eot, int eos) {
+    Q_UNUSED(sad)
+    Q_UNUSED(eot)
+    Q_UNUSED(eos)
+    QMutexLocker locker(&busMutex);
+    Device newDevice;
+    newDevice.board      = board;
+    newDevice.pad        = pad;
+    newDevice.timeout    = tmo;
+    newDevice.bOnline    = true;
+    newDevice.bReading   = false;
+    newDevice.readEnd    = 0;
+    newDevice.readStatus = 0;
+    newDevice.readCount  = 0;
+    devices.append(newDevice);
+    setResult(CMPL, 0, 0);
+    return FIRST_DEVICE_DESCRIPTOR + devices.count() - 1;
+}
+
+
+int
+EmulatedGpibTransport::setOnline(int ud, int v) {
+    QMutexLocker locker(&busMutex);
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    pDevice->bOnline = (v != 0);
+    return setResult(CMPL, 0, 0);
+}
+
+
+int
+EmulatedGpibTransport::clearDevice(int ud) {
+    QMutexLocker locker(&busMutex);
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    K236Emulator* pInstrument = instrumentAt(pDevice->pad);
+    if(!pInstrument)
+        return setResult(ERR, ENOL, 0);
+    transferDelay(2);
+    pInstrument->clear(now());
+    talkBuffer.remove(pDevice->pad);
+    return setResult(CMPL, 0, 0);
+}
+
+
+int
+EmulatedGpibTransport::isListener(int board, int pad, int sad, short *listen) {
+    Q_UNUSED(board)
+    Q_UNUSED(sad)
+    QMutexLocker locker(&busMutex);
+    transferDelay(2);
+    *listen = (instrumentAt(pad) != nullptr) ? 1 : 0;
+    return setResult(CMPL, 0, 0);
+}
+
+
+int
+EmulatedGpibTransport::write(int ud, const char *data, long count) {
+    QMutexLocker locker(&busMutex);
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    K236Emulator* pInstrument = instrumentAt(pDevice->pad);
+    if(!pInstrument)
+        return setResult(ERR, ENOL, 0);
+    return listenTo(pInstrument, data, count);
+}
+
+
+int
+EmulatedGpibTransport::read(int ud, char *buffer, long count) {
+    QMutexLocker locker(&busMutex);
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    K236Emulator* pInstrument = instrumentAt(pDevice->pad);
+    if(!pInstrument)
+        return setResult(ERR, ENOL, 0);
+    return talkFrom(pInstrument, buffer, count, pDevice->timeout);
+}
+
+
+int
+EmulatedGpibTransport::serialPoll(int ud, char *result) {
+    QMutexLocker locker(&busMutex);
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    K236Emulator* pInstrument = instrumentAt(pDevice->pad);
+    if(!pInstrument)
+        return setResult(ERR, ENOL, 0);
+    transferDelay(4);
+    *result = pInstrument->serialPoll(now());
+    return setResult(CMPL, 0, 1);
+}
+
+
+// The data are copied at once but are made available (CMPL)
+// only after the time needed for their transfer; meanwhile
+// the bus is busy
+int
+EmulatedGpibTransport::readAsync(int ud, char *buffer, long count) {
+    QMutexLocker locker(&busMutex);
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    if(pDevice->bReading)
+        return setResult(ERR, EOIP, 0);
+    K236Emulator* pInstrument = instrumentAt(pDevice->pad);
+    if(!pInstrument)
+        return setResult(ERR, ENOL, 0);
+    transferDelay(0); // Previous transfers
+    int sta = talkFrom(pInstrument, buffer, count, pDevice->timeout, false);
+    if(sta & ERR)
+        return sta;
+    pDevice->bReading   = true;
+    pDevice->readStatus = sta;
+    pDevice->readCount  = this->count();
+    pDevice->readEnd    = now() + pDevice->readCount*K236Emulator::byteTime;
+    busBusyUntil = pDevice->readEnd;
+    return setResult(0, 0, 0);
+}
+
+
+int
+EmulatedGpibTransport::stop(int ud) {
+    QMutexLocker locker(&busMutex);
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    if(!pDevice->bReading)
+        return setResult(CMPL, 0, 0);
+    pDevice->bReading = false;
+    busBusyUntil = 0;
+    return setResult(ERR | CMPL, EABO, 0);
+}
+
+
+// Completion of an asynchronous read (called with busMutex locked)
+int
+EmulatedGpibTransport::waitRead(Device *pDevice, int mask) {
+    if(!pDevice->bReading)
+        return setResult(CMPL, 0, 0);
+    qint64 tMax = emulatedgpibtransport::timeoutTime[qBound(0, pDevice->timeout, 17)];
+    qint64 tWait = pDevice->readEnd - now();
+    if((mask & TIMO) && (tMax > 0) && (tWait > tMax)) {
+        QThread::usleep(ulong(tMax));
+        return setResult(TIMO, 0, 0);
+    }
+    if(tWait > 0)
+        QThread::usleep(ulong(tWait));
+    pDevice->bReading = false;
+    return setResult(pDevice->readStatus, 0, pDevice->readCount);
+}
+
+
+int
+EmulatedGpibTransport::trigger(int ud) {
+    QMutexLocker locker(&busMutex);
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    K236Emulator* pInstrument = instrumentAt(pDevice->pad);
+    if(!pInstrument)
+        return setResult(ERR, ENOL, 0);
+    transferDelay(2);
+    pInstrument->trigger(now());
+    return setResult(CMPL, 0, 0);
+}
+
+
+// Wait for SRQI (board descriptors) or RQS (device descriptors)
+// and/or for the timeout. The bus is not used while waiting.
+int
+EmulatedGpibTransport::wait(int ud, int mask) {
+    bool bBoard = (ud < FIRST_DEVICE_DESCRIPTOR);
+    K236Emulator* pInstrument = nullptr;
+    int timeout;
+    {
+        QMutexLocker locker(&busMutex);
+        if(bBoard) {
+            timeout = boardTimeout.value(ud, T3s);
+        }
+        else {
+            Device* pDevice = device(ud);
+            if(!pDevice)
+                return setResult(ERR, EDVR, 0);
+            if(mask & CMPL)
+                return waitRead(pDevice, mask);
+            pInstrument = instrumentAt(pDevice->pad);
+            if(!pInstrument)
+                return setResult(ERR, ENOL, 0);
+            timeout = pDevice->timeout;
+        }
+    }
+    int event = bBoard ? SRQI : RQS;
+    qint64 tMax = emulatedgpibtransport::timeoutTime[qBound(0, timeout, 17)];
+    qint64 t0 = now();
+    while(true) {
+        bool bRequest = false;
+        {
+            QMutexLocker locker(&busMutex);
+            for(int i=0; i<instruments.count(); i++) {
+                if(((pInstrument == nullptr) || (pInstrument == instruments.at(i))) &&
+                   instruments.at(i)->isRequestingService(now()))
+                    bRequest = true;
+            }
+        }
+        int sta = CMPL | (bRequest ? event : 0);
+        if((mask & event) && bRequest)
+            return setResult(sta, 0, 0);
+        if(!(mask & (event | TIMO)))
+            return setResult(sta, 0, 0);
+        if((mask & TIMO) && (tMax > 0) && (now()-t0 >= tMax))
+            return setResult(sta | TIMO, 0, 0);
+        QThread::usleep(SRQ_CHECK_TIME);
+    }
+}
+
+
+int
+EmulatedGpibTransport::setTimeout(int ud, int tmo) {
+    QMutexLocker locker(&busMutex);
+    if(ud < FIRST_DEVICE_DESCRIPTOR) {
+        boardTimeout[ud] = tmo;
+        return setResult(CMPL, 0, 0);
+    }
+    Device* pDevice = device(ud);
+    if(!pDevice)
+        return setResult(ERR, EDVR, 0);
+    pDevice->timeout = tmo;
+    return setResult(CMPL, 0, 0);
+}
+
+
+void
+EmulatedGpibTransport::sendIFC(int board) {
+    Q_UNUSED(board)
+    QMutexLocker locker(&busMutex);
+    talkBuffer.clear();
+    setResult(CMPL, 0, 0);
+}
+
+
+int
+EmulatedGpibTransport::configure(int board, int option, int value) {
+    Q_UNUSED(board)
+    Q_UNUSED(option)
+    Q_UNUSED(value)
+    return setResult(CMPL, 0, 0);
+}
+
+
+void
+EmulatedGpibTransport::devClearList(int board, const Addr4882_t *addrList) {
+    if(addrList[0] == NOADDR) { // Universal Device Clear (DCL)
+        devClear(board, NOADDR);
+        return;
+    }
+    for(int i=0; addrList[i]!=NOADDR; i++)
+        devClear(board, addrList[i]);
+}
+
+
+void
+EmulatedGpibTransport::devClear(int board, Addr4882_t address) {
+    Q_UNUSED(board)
+    QMutexLocker locker(&busMutex);
+    transferDelay(2);
+    for(int i=0; i<instruments.count(); i++) {
+        if((address == NOADDR) || (instruments.at(i)->address() == GetPAD(address))) {
+            instruments.at(i)->clear(now());
+            talkBuffer.remove(instruments.at(i)->address());
+        }
+    }
+    setResult(CMPL, 0, 0);
+}
+
+
+void
+EmulatedGpibTransport::findListeners(int board, const Addr4882_t *padList,
+                                     Addr4882_t *resultList, int limit) {
+    Q_UNUSED(board)
+    QMutexLocker locker(&busMutex);
+    int nFound = 0;
+    for(int i=0; (padList[i]!=NOADDR) && (nFound<limit); i++) {
+        transferDelay(2);
+        if(instrumentAt(GetPAD(padList[i])))
+            resultList[nFound++] = padList[i];
+    }
+    setResult(CMPL, 0, nFound);
+}
+
+
+void
+EmulatedGpibTransport::send(int board, Addr4882_t address,
+                            const void *data, long count, int eotMode) {
+    Q_UNUSED(board)
+    Q_UNUSED(eotMode)
+    QMutexLocker locker(&busMutex);
+    K236Emulator* pInstrument = instrumentAt(GetPAD(address));
+    if(!pInstrument) {
+        setResult(ERR, ENOL, 0);
+        return;
+    }
+    listenTo(pInstrument, reinterpret_cast<const char*>(data), count);
+}
+
+
+void
+EmulatedGpibTransport::receive(int board, Addr4882_t address,
+                               void *buffer, long count, int termination) {
+    Q_UNUSED(board)
+    Q_UNUSED(termination)
+    QMutexLocker locker(&busMutex);
+    K236Emulator* pInstrument = instrumentAt(GetPAD(address));
+    if(!pInstrument) {
+        setResult(ERR, ENOL, 0);
+        return;
+    }
+    talkFrom(pInstrument, reinterpret_cast<char*>(buffer), count, T3s);
+}
+
+
+// Serial poll the listed devices until one requesting service is
+// found: ibcnt is its index (the index of NOADDR if none is found)
+void
+EmulatedGpibTransport::findRequester(int board, const Addr4882_t *addrList, short *result) {
+    Q_UNUSED(board)
+    QMutexLocker locker(&busMutex);
+    int i;
+    for(i=0; addrList[i]!=NOADDR; i++) {
+        K236Emulator* pInstrument = instrumentAt(GetPAD(addrList[i]));
+        if(!pInstrument) {
+            setResult(ERR, ENOL, i);
+            return;
+        }
+        transferDelay(4);
+        char statusByte = pInstrument->serialPoll(now());
+        if(statusByte & K236Emulator::RQS_BIT) {
+            *result = short(quint8(statusByte));
+            setResult(CMPL, 0, i);
+            return;
+        }
+    }
+    setResult(ERR, ETAB, i);
+}
+
+
+void
+EmulatedGpibTransport::allSerialPoll(int board, const Addr4882_t *addrList, short *resultList) {
+    Q_UNUSED(board)
+    QMutexLocker locker(&busMutex);
+    int i;
+    for(i=0; addrList[i]!=NOADDR; i++) {
+        K236Emulator* pInstrument = instrumentAt(GetPAD(addrList[i]));
+        if(!pInstrument) {
+            setResult(ERR, ENOL, i);
+            return;
+        }
+        transferDelay(4);
+        resultList[i] = short(quint8(pInstrument->serialPoll(now())));
+    }
+    setResult(CMPL, 0, i);
+}
+
+
+// The listed instruments are addressed to listen and receive
+// a single GET: they are all triggered at the same time
+void
+EmulatedGpibTransport::triggerList(int board, const Addr4882_t *addrList) {
+    Q_UNUSED(board)
+    QMutexLocker locker(&busMutex);
+    QList<K236Emulator*> listeners;
+    for(int i=0; addrList[i]!=NOADDR; i++) {
+        K236Emulator* pInstrument = instrumentAt(GetPAD(addrList[i]));
+        if(!pInstrument) {
+            setResult(ERR, ENOL, 0);
+            return;
+        }
+        listeners.append(pInstrument);
+    }
+    transferDelay(listeners.count()+2); // UNL, listen addresses, GET
+    qint64 t = now();
+    for(int i=0; i<listeners.count(); i++)
+        listeners.at(i)->trigger(t);
+    setResult(CMPL, 0, 0);
+}
+
+
+int
+EmulatedGpibTransport::status() {
+    return emulatedgpibtransport::threadIbsta;
+}
+
+
+int
+EmulatedGpibTransport::error() {
+    return emulatedgpibtransport::threadIberr;
+}
+
+
+long
+EmulatedGpibTransport::count() {
+    return emulatedgpibtransport::threadIbcnt;
+}
+
+
+bool
+EmulatedGpibTransport::isEmulated() const {
+    return true;
+}
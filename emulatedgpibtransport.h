@@ -0,0 +1,110 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include "gpibtransport.h"
+#include "k236emulator.h"
+
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QMap>
+
+
+// An in-process GPIB bus with two emulated Keithley 236 connected
+// to a GFET: the first one (lowest address) measures Ids,
+// the second generates Vg. The TRIGGER OUT of the Vg unit is
+// connected to the TRIGGER IN of the Ids unit.
+// The bus is a shared medium: a single call at a time is served
+// and the transfers last as long as on the real instruments.
+class EmulatedGpibTransport : public GpibTransport
+{
+public:
+    explicit EmulatedGpibTransport(int idsAddress=16, int vgAddress=17);
+    ~EmulatedGpibTransport();
+
+public:
+    int  openDevice(int board, int pad, int sad, int tmo, int eot, int eos);
+    int  setOnline(int ud, int v);
+    int  clearDevice(int ud);
+    int  isListener(int board, int pad, int sad, short *listen);
+    int  write(int ud, const char *data, long count);
+    int  read(int ud, char *buffer, long count);
+    int  serialPoll(int ud, char *result);
+    int  trigger(int ud);
+    int  readAsync(int ud, char *buffer, long count);
+    int  stop(int ud);
+
+    int  wait(int ud, int mask);
+    int  setTimeout(int ud, int tmo);
+
+    void sendIFC(int board);
+    int  configure(int board, int option, int value);
+    void devClearList(int board, const Addr4882_t *addrList);
+    void devClear(int board, Addr4882_t address);
+    void findListeners(int board, const Addr4882_t *padList,
+                       Addr4882_t *resultList, int limit);
+    void send(int board, Addr4882_t address,
+              const void *data, long count, int eotMode);
+    void receive(int board, Addr4882_t address,
+                 void *buffer, long count, int termination);
+    void findRequester(int board, const Addr4882_t *addrList, short *result);
+    void allSerialPoll(int board, const Addr4882_t *addrList, short *resultList);
+    void triggerList(int board, const Addr4882_t *addrList);
+
+    int  status();
+    int  error();
+    long count();
+
+    bool isEmulated() const;
+
+private:
+    struct Device {
+        int  board;
+        int  pad;
+        int  timeout;
+        bool bOnline;
+        // Asynchronous read in progress
+        bool   bReading;
+        qint64 readEnd;
+        int    readStatus;
+        long   readCount;
+    };
+
+private:
+    qint64        now();
+    K236Emulator* instrumentAt(int pad);
+    Device*       device(int ud);
+    int           setResult(int sta, int err, long cnt);
+    void          transferDelay(long nBytes);
+    int           listenTo(K236Emulator *pInstrument, const char *data, long count);
+    int           talkFrom(K236Emulator *pInstrument, char *buffer, long count, int timeout,
+                           bool bWait=true);
+    int           waitRead(Device *pDevice, int mask);
+
+private:
+    QMutex                   busMutex;
+    QElapsedTimer            clock;
+    GFetModel                sample;
+    QList<K236Emulator*>     instruments;
+    QVector<Device>          devices;
+    QMap<int, QByteArray>    talkBuffer; // Bytes not yet read (by address)
+    QMap<int, int>           boardTimeout;
+    qint64                   busBusyUntil; // End of the asynchronous transfer in progress
+};
@@ -51,6 +51,7 @@ Fake236::Fake236(int gpio, int address, QObject *parent)
     , isSweeping(false)
 {
     iComplianceEvents = 0;
+    pollTimer.setParent(this); // Follow the device in its thread
     pollInterval = 569;
 }
 
@@ -63,7 +64,7 @@ Fake236::~Fake236() {
 #else
         ibnotify(gpibId, 0, NULL, NULL);// disable notification
 #endif
-        ibonl(gpibId, 0);// Disable hardware and software.
+        pBus->setOnline(gpibId, 0);// Disable hardware and software.
     }
 }
 
@@ -141,7 +142,7 @@ Fake236::onGpibCallback(int LocalUd, unsigned long LocalIbsta, unsigned long Loc
     Q_UNUSED(LocalIbcntl)
 
     spollByte = 0;
-    int iStatus = ibrsp(LocalUd, &spollByte);
+    int iStatus = pBus->serialPoll(LocalUd, &spollByte);
     if(iStatus & ERR) {
         emit sendMessage(QString(Q_FUNC_INFO) + QString("GPIB error %1").arg(LocalIberr));
         emit sendMessage(QString(Q_FUNC_INFO) + QString("ibrsp() returned: %1").arg(iStatus));
@@ -201,7 +202,7 @@ Fake236::onGpibCallback(int LocalUd, unsigned long LocalIbsta, unsigned long Loc
 
 bool
 Fake236::isReadyForTrigger() {
-    ibrsp(gpibId, &spollByte);
+    pBus->serialPoll(gpibId, &spollByte);
     if(isGpibError(QString(Q_FUNC_INFO) + ": Error in ibrsp()"))
         return false;
     return ((spollByte & READY_FOR_TRIGGER) != 0);
@@ -210,7 +211,7 @@ Fake236::isReadyForTrigger() {
 
 bool
 Fake236::sendTrigger() {
-    ibtrg(gpibId);
+    pBus->trigger(gpibId);
     if(isGpibError(QString(Q_FUNC_INFO) + "Trigger Error"))
         return false;
     return true;
@@ -220,6 +221,6 @@ Fake236::sendTrigger() {
 void
 Fake236::checkNotify() {
 #if defined(Q_OS_LINUX)
-    onGpibCallback(gpibId, uint(ThreadIbsta()), uint(ThreadIberr()), ThreadIbcnt());
+    onGpibCallback(gpibId, uint(pBus->status()), uint(pBus->error()), pBus->count());
 #endif
 }
@@ -70,6 +70,8 @@ public:
 
 
 private:
+    QTimer pollTimer;
+    int    pollInterval;
     bool   bStop;
     int    iComplianceEvents;
     double lastReading;
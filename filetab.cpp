@@ -32,6 +32,10 @@ FileTab::FileTab(QWidget *parent)
     : QWidget(parent)
     , sBaseDir(QDir::homePath())
     , sOutFileName("data.dat")
+    , flushPointsMin(1)
+    , flushPointsMax(100000)
+    , flushIntervalMin(100)
+    , flushIntervalMax(60000)
 {
     outFilePathButton.setText(QString("..."));
 
@@ -44,8 +48,29 @@ FileTab::FileTab(QWidget *parent)
     pLayout->addWidget(&outFileEdit,                     1, 1, 1, 6);
     pLayout->addWidget(new QLabel("Sample Information"), 2, 0, 1, 7);
     pLayout->addWidget(&sampleInformationEdit,           3, 0, 4, 7);
+    pLayout->addWidget(new QLabel("Flush every [points]"), 7, 0, 1, 1);
+    pLayout->addWidget(&flushPointsEdit,                 7, 1, 1, 1);
+    pLayout->addWidget(new QLabel("or every [ms]"),      7, 2, 1, 1);
+    pLayout->addWidget(&flushIntervalEdit,               7, 3, 1, 1);
+    pLayout->addWidget(&syncBox,                         8, 0, 1, 7);
+    pLayout->addWidget(&binaryBox,                       9, 0, 1, 7);
+    pLayout->addWidget(&singleFileBox,                  10, 0, 1, 7);
+    pLayout->addWidget(&compressBox,                    11, 0, 1, 7);
     setLayout(pLayout);
 
+    sNormalStyle = flushPointsEdit.styleSheet();
+
+    sErrorStyle  = "QLineEdit { ";
+    sErrorStyle += "color: rgb(255, 255, 255);";
+    sErrorStyle += "background: rgb(255, 0, 0);";
+    sErrorStyle += "selection-background-color: rgb(128, 128, 255);";
+    sErrorStyle += "}";
+
+    syncBox.setText("Force the Output to Disk at every Step");
+    binaryBox.setText("Binary Run File (.gfr) too");
+    singleFileBox.setText("One Text File per Run");
+    compressBox.setText("Compressed Output (.gfz)");
+
     connectSignals();
     restoreSettings();
     setToolTips();
@@ -58,6 +83,16 @@ FileTab::initUI() {
     sampleInformationEdit.setPlainText(sSampleInfo);
     outPathEdit.setText(sBaseDir);
     outFileEdit.setText(sOutFileName);
+    if(!isFlushPointsValid(iFlushPoints))
+        iFlushPoints = 100;
+    flushPointsEdit.setText(QString("%1").arg(iFlushPoints));
+    if(!isFlushIntervalValid(iFlushInterval))
+        iFlushInterval = 1000;
+    flushIntervalEdit.setText(QString("%1").arg(iFlushInterval));
+    syncBox.setChecked(bSyncAtStepEnd);
+    binaryBox.setChecked(bBinaryOutput);
+    singleFileBox.setChecked(bSingleFile);
+    compressBox.setChecked(bCompressed);
 }
 
 
@@ -67,6 +102,13 @@ FileTab::setToolTips() {
     outPathEdit.setToolTip(QString("Output File Folder"));
     outFileEdit.setToolTip(QString("Enter Output File Name"));
     outFilePathButton.setToolTip((QString("Press to Change Output File Folder")));
+    QString sHeader = QString("Enter values in range [%1 : %2]");
+    flushPointsEdit.setToolTip(sHeader.arg(flushPointsMin).arg(flushPointsMax));
+    flushIntervalEdit.setToolTip(sHeader.arg(flushIntervalMin).arg(flushIntervalMax));
+    syncBox.setToolTip(QString("Wait for the disk at the end of every step (fsync)"));
+    binaryBox.setToolTip(QString("All the run in a compact binary file, with an index of the steps"));
+    singleFileBox.setToolTip(QString("All the steps in the same file (a GnuPlot index each), with an index at the end"));
+    compressBox.setToolTip(QString("The run file and the journal compressed block by block"));
 }
 
 
@@ -74,6 +116,18 @@ void
 FileTab::connectSignals() {
     connect(&outFilePathButton, SIGNAL(clicked()),
             this, SLOT(on_outFilePathButton_clicked()));
+    connect(&flushPointsEdit, SIGNAL(textChanged(const QString)),
+            this, SLOT(onFlushPointsEdit_textChanged(const QString)));
+    connect(&flushIntervalEdit, SIGNAL(textChanged(const QString)),
+            this, SLOT(onFlushIntervalEdit_textChanged(const QString)));
+    connect(&syncBox, SIGNAL(toggled(bool)),
+            this, SLOT(onSyncBox_toggled(bool)));
+    connect(&binaryBox, SIGNAL(toggled(bool)),
+            this, SLOT(onBinaryBox_toggled(bool)));
+    connect(&singleFileBox, SIGNAL(toggled(bool)),
+            this, SLOT(onSingleFileBox_toggled(bool)));
+    connect(&compressBox, SIGNAL(toggled(bool)),
+            this, SLOT(onCompressBox_toggled(bool)));
 }
 
 
@@ -83,6 +137,12 @@ FileTab::restoreSettings() {
     sSampleInfo    = settings.value("FileTabSampleInfo", "").toString();
     sBaseDir       = settings.value("FileTabBaseDir", sBaseDir).toString();
     sOutFileName   = settings.value("FileTabOutFileName", sOutFileName).toString();
+    iFlushPoints   = settings.value("FileTabFlushPoints", 100).toInt();
+    iFlushInterval = settings.value("FileTabFlushInterval", 1000).toInt();
+    bSyncAtStepEnd = settings.value("FileTabSyncAtStepEnd", true).toBool();
+    bBinaryOutput  = settings.value("FileTabBinaryOutput", false).toBool();
+    bSingleFile    = settings.value("FileTabSingleFile", false).toBool();
+    bCompressed    = settings.value("FileTabCompressed", false).toBool();
 }
 
 
@@ -93,6 +153,12 @@ FileTab::saveSettings() {
     settings.setValue("FileTabSampleInfo", sSampleInfo);
     settings.setValue("FileTabBaseDir", sBaseDir);
     settings.setValue("FileTabOutFileName", sOutFileName);
+    settings.setValue("FileTabFlushPoints", iFlushPoints);
+    settings.setValue("FileTabFlushInterval", iFlushInterval);
+    settings.setValue("FileTabSyncAtStepEnd", bSyncAtStepEnd);
+    settings.setValue("FileTabBinaryOutput", bBinaryOutput);
+    settings.setValue("FileTabSingleFile", bSingleFile);
+    settings.setValue("FileTabCompressed", bCompressed);
 }
 
 
@@ -137,3 +203,65 @@ FileTab::checkFileName() {
     }
     return true;
 }
+
+
+bool
+FileTab::isFlushPointsValid(int iPoints) {
+    return (iPoints >= flushPointsMin) && (iPoints <= flushPointsMax);
+}
+
+
+bool
+FileTab::isFlushIntervalValid(int iInterval) {
+    return (iInterval >= flushIntervalMin) && (iInterval <= flushIntervalMax);
+}
+
+
+void
+FileTab::onFlushPointsEdit_textChanged(const QString &arg1) {
+    int iTemp = arg1.toInt();
+    if(isFlushPointsValid(iTemp)) {
+        iFlushPoints = iTemp;
+        flushPointsEdit.setStyleSheet(sNormalStyle);
+    }
+    else {
+        flushPointsEdit.setStyleSheet(sErrorStyle);
+    }
+}
+
+
+void
+FileTab::onFlushIntervalEdit_textChanged(const QString &arg1) {
+    int iTemp = arg1.toInt();
+    if(isFlushIntervalValid(iTemp)) {
+        iFlushInterval = iTemp;
+        flushIntervalEdit.setStyleSheet(sNormalStyle);
+    }
+    else {
+        flushIntervalEdit.setStyleSheet(sErrorStyle);
+    }
+}
+
+
+void
+FileTab::onSyncBox_toggled(bool bChecked) {
+    bSyncAtStepEnd = bChecked;
+}
+
+
+void
+FileTab::onBinaryBox_toggled(bool bChecked) {
+    bBinaryOutput = bChecked;
+}
+
+
+void
+FileTab::onSingleFileBox_toggled(bool bChecked) {
+    bSingleFile = bChecked;
+}
+
+
+void
+FileTab::onCompressBox_toggled(bool bChecked) {
+    bCompressed = bChecked;
+}
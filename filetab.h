@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QLineEdit>
 #include <QPlainTextEdit>
 #include <QPushButton>
+#include <QCheckBox>
 
 
 class FileTab : public QWidget
@@ -38,20 +39,50 @@ signals:
 
 public slots:
     void on_outFilePathButton_clicked();
+    void onFlushPointsEdit_textChanged(const QString &arg1);
+    void onFlushIntervalEdit_textChanged(const QString &arg1);
+    void onSyncBox_toggled(bool bChecked);
+    void onBinaryBox_toggled(bool bChecked);
+    void onSingleFileBox_toggled(bool bChecked);
+    void onCompressBox_toggled(bool bChecked);
 
 protected:
     void initUI();
     void setToolTips();
     void connectSignals();
+    bool isFlushPointsValid(int iPoints);
+    bool isFlushIntervalValid(int iInterval);
 
 public:
     QString sSampleInfo;
     QString sBaseDir;
     QString sOutFileName;
+    int     iFlushPoints;   // Output flushed after so many points...
+    int     iFlushInterval; // [ms] ...or after so long
+    bool    bSyncAtStepEnd; // Output forced to the disk at every step
+    bool    bBinaryOutput;  // Binary run file along with the text files
+    bool    bSingleFile;    // All the steps in one text file
+    bool    bCompressed;    // Block compressed run file and journal
 
 private:
+    // Limit Values
+    const int flushPointsMin;
+    const int flushPointsMax;
+    const int flushIntervalMin;
+    const int flushIntervalMax;
+
+    // QLineEdit styles
+    QString sNormalStyle;
+    QString sErrorStyle;
+
     QPlainTextEdit sampleInformationEdit;
     QLineEdit      outPathEdit;
     QLineEdit      outFileEdit;
     QPushButton    outFilePathButton;
+    QLineEdit      flushPointsEdit;
+    QLineEdit      flushIntervalEdit;
+    QCheckBox      syncBox;
+    QCheckBox      binaryBox;
+    QCheckBox      singleFileBox;
+    QCheckBox      compressBox;
 };
@@ -29,6 +29,8 @@ SOURCES += idstab.cpp
 SOURCES += vgtab.cpp
 SOURCES += mainwindow.cpp
 SOURCES += axesdialog.cpp
+SOURCES += binarysink.cpp
+SOURCES += blockfile.cpp
 SOURCES += AxisFrame.cpp
 SOURCES += AxisLimits.cpp
 SOURCES += configuredialog.cpp
@@ -36,9 +38,22 @@ SOURCES += DataSetProperties.cpp
 SOURCES += datastream2d.cpp
 SOURCES += filetab.cpp
 SOURCES += gpibdevice.cpp
+SOURCES += gpibtransport.cpp
+SOURCES += emulatedgpibtransport.cpp
+SOURCES += gpibworker.cpp
+SOURCES += journalsink.cpp
+SOURCES += k236emulator.cpp
+SOURCES += k236parser.cpp
 SOURCES += keithley236.cpp
 SOURCES += plot2d.cpp
 SOURCES += plotpropertiesdlg.cpp
+SOURCES += runfilesink.cpp
+SOURCES += runwriter.cpp
+SOURCES += scanplanner.cpp
+SOURCES += settlingdetector.cpp
+SOURCES += srqdispatcher.cpp
+SOURCES += textsink.cpp
+SOURCES += vgstepper.cpp
 
 
 HEADERS += mainwindow.h
@@ -46,6 +61,8 @@ HEADERS +=  fake236.h
 HEADERS += idstab.h
 HEADERS += vgtab.h
 HEADERS += axesdialog.h
+HEADERS += binarysink.h
+HEADERS += blockfile.h
 HEADERS += AxisFrame.h
 HEADERS += AxisLimits.h
 HEADERS += configuredialog.h
@@ -53,17 +70,41 @@ HEADERS += DataSetProperties.h
 HEADERS += datastream2d.h
 HEADERS += filetab.h
 HEADERS += gpibdevice.h
+HEADERS += gpibtransport.h
+HEADERS += gpibconstants.h
+HEADERS += emulatedgpibtransport.h
+HEADERS += gpibworker.h
+HEADERS += journalsink.h
+HEADERS += k236emulator.h
+HEADERS += k236parser.h
+HEADERS += k236reading.h
 HEADERS += keithley236.h
 HEADERS += plot2d.h
 HEADERS += plotpropertiesdlg.h
+HEADERS += runfilesink.h
+HEADERS += runwriter.h
+HEADERS += scanplanner.h
+HEADERS += settlingdetector.h
+HEADERS += srqdispatcher.h
+HEADERS += textsink.h
+HEADERS += vgstepper.h
 
 
 FORMS   += mainwindow.ui
 
 
-# For National Instruments GPIB Boards
-LIBS += -L"/usr/local/lib" -lgpib # To include libgpib.so from /usr/local/lib
-INCLUDEPATH += /usr/local/include
+# "qmake CONFIG+=gpib_emulator" builds a gfet that does not need
+# linux-gpib: only the in-process Keithley 236 emulator is available.
+# Otherwise the emulator can be selected at run time with --emulator
+gpib_emulator {
+    DEFINES += GPIB_EMULATOR_ONLY
+} else {
+    SOURCES += linuxgpibtransport.cpp
+    HEADERS += linuxgpibtransport.h
+    # For National Instruments GPIB Boards
+    LIBS += -L"/usr/local/lib" -lgpib # To include libgpib.so from /usr/local/lib
+    INCLUDEPATH += /usr/local/include
+}
 
 
 DISTFILES += .gitignore
@@ -0,0 +1,122 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+// The subset of the linux-gpib <gpib/ib.h> definitions used by gfet.
+// It is only used when building without linux-gpib (CONFIG+=gpib_emulator)
+// and the values are the same of the library ones.
+
+#include <stdint.h>
+
+
+typedef uint16_t Addr4882_t;
+
+#define NOADDR   Addr4882_t(0xffff)
+#define NO_SAD   0
+#define ALL_SAD  -1
+
+#define MakeAddr(pad, sad) Addr4882_t(((pad) & 0xff) | (((sad) & 0xff) << 8))
+#define GetPAD(address)    ((address) & 0xff)
+#define GetSAD(address)    (((address) >> 8) & 0xff)
+
+// ibsta bits
+enum ibsta_bits {
+    DCAS = 0x1,
+    DTAS = 0x2,
+    LACS = 0x4,
+    TACS = 0x8,
+    ATN  = 0x10,
+    CIC  = 0x20,
+    REM  = 0x40,
+    LOK  = 0x80,
+    CMPL = 0x100,
+    EVENT= 0x200,
+    SPOLL= 0x400,
+    RQS  = 0x800,
+    SRQI = 0x1000,
+    END  = 0x2000,
+    TIMO = 0x4000,
+    ERR  = 0x8000
+};
+
+// iberr codes
+enum iberr_code {
+    EDVR = 0,
+    ECIC = 1,
+    ENOL = 2,
+    EADR = 3,
+    EARG = 4,
+    ESAC = 5,
+    EABO = 6,
+    ENEB = 7,
+    EDMA = 8,
+    EOIP = 10,
+    ECAP = 11,
+    EFSO = 12,
+    EBUS = 14,
+    ESTB = 15,
+    ESRQ = 16,
+    ETAB = 20
+};
+
+// Timeout values for ibdev() and ibtmo()
+enum gpib_timeout {
+    TNONE   = 0,
+    T10us   = 1,
+    T30us   = 2,
+    T100us  = 3,
+    T300us  = 4,
+    T1ms    = 5,
+    T3ms    = 6,
+    T10ms   = 7,
+    T30ms   = 8,
+    T100ms  = 9,
+    T300ms  = 10,
+    T1s     = 11,
+    T3s     = 12,
+    T10s    = 13,
+    T30s    = 14,
+    T100s   = 15,
+    T300s   = 16,
+    T1000s  = 17
+};
+
+// ibconfig() options
+enum ibconfig_option {
+    IbcPAD      = 0x1,
+    IbcSAD      = 0x2,
+    IbcTMO      = 0x3,
+    IbcEOT      = 0x4,
+    IbcPPC      = 0x5,
+    IbcREADDR   = 0x6,
+    IbcAUTOPOLL = 0x7,
+    IbcCICPROT  = 0x8,
+    IbcIRQ      = 0x9,
+    IbcSC       = 0xa,
+    IbcSRE      = 0xb
+};
+
+// End modes for Send() and Receive()
+enum send_eotmode {
+    NULLend = 0,
+    NLend   = 1,
+    DABend  = 2
+};
+
+#define STOPend 0x100
@@ -1,19 +1,23 @@
 #include "gpibdevice.h"
 //#include <QDebug>
 
+#define READ_CHUNK 2000 // [bytes]
+
 GpibDevice::GpibDevice(int gpio, int address, QObject *parent)
     : QObject(parent)
+    , pBus(GpibTransport::instance())
     , gpibNumber(gpio)
     , gpibAddress(address)
     , gpibId(-1)
+    , bSrqEnabled(false)
 {
 }
 
 
 bool
 GpibDevice::isGpibError(QString sErrorString) {
-    if(ThreadIbsta() & ERR) {
-        QString sError = ErrMsg(ThreadIbsta(), ThreadIberr(), ThreadIbcnt());
+    if(pBus->status() & ERR) {
+        QString sError = ErrMsg(pBus->status(), pBus->error(), pBus->count());
         emit sendMessage(sErrorString + QString("\n") + sError);
         return true;
     }
@@ -70,9 +74,9 @@ GpibDevice::ErrMsg(int sta, int err, long cntl) {
 uint
 GpibDevice::gpibWrite(int ud, QString sCmd) {
     //qDebug() << QString("Writing %1 bytes of data: Data = %2").arg(sCmd.length()).arg(sCmd.toUtf8().constData());
-    ibwrt(ud, sCmd.toUtf8().constData(), sCmd.length());
+    pBus->write(ud, sCmd.toUtf8().constData(), sCmd.length());
     isGpibError("GPIB Writing Error Writing");
-    return uint(ThreadIbsta());
+    return uint(pBus->status());
 }
 
 
@@ -80,16 +84,37 @@ QString
 GpibDevice::gpibRead(int ud) {
     QString sString;
     do {
-        ibrd(ud, readBuf, sizeof(readBuf)-1);
+        pBus->read(ud, readBuf, sizeof(readBuf)-1);
         if(isGpibError("GPIB Reading Error"))
             return QString();
-        readBuf[ThreadIbcnt()] = 0;
+        readBuf[pBus->count()] = 0;
         sString += QString(readBuf);
-    } while(ThreadIbcnt() == sizeof(readBuf)-1);
+    } while(pBus->count() == sizeof(readBuf)-1);
     return sString;
 }
 
 
+// Read directly into a buffer reused from call to call:
+// once reserve()d to the expected size no allocation takes place
+bool
+GpibDevice::gpibRead(int ud, QByteArray &buffer) {
+    buffer.resize(0);
+    int chunk;
+    do {
+        int nRead = buffer.size();
+        chunk = qMax(buffer.capacity()-nRead, READ_CHUNK);
+        buffer.resize(nRead+chunk);
+        pBus->read(ud, buffer.data()+nRead, chunk);
+        if(isGpibError("GPIB Reading Error")) {
+            buffer.resize(0);
+            return false;
+        }
+        buffer.resize(nRead+int(pBus->count()));
+    } while(pBus->count() == chunk);
+    return true;
+}
+
+
 int
 GpibDevice::init() {
     return NO_ERROR;
@@ -108,3 +133,25 @@ GpibDevice::onGpibCallback(int LocalUd, unsigned long LocalIbsta, unsigned long
 void
 GpibDevice::checkNotify() {
 }
+
+
+// Called (by the SRQ dispatcher) when SRQ is asserted on the bus:
+// returns true if this device was requesting service
+bool
+GpibDevice::serviceRequest() {
+    return false;
+}
+
+
+// Called (by the SRQ dispatcher) with the status byte of this device
+// when it has been found requesting service in a bus-wide poll
+void
+GpibDevice::onServiceRequest(char statusByte) {
+    Q_UNUSED(statusByte)
+}
+
+
+int
+GpibDevice::address() const {
+    return gpibAddress;
+}
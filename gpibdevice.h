@@ -20,14 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <QtGlobal>
 #include <QObject>
-#include <QTimer>
 
-
-#if defined(Q_OS_LINUX)
-#include <gpib/ib.h>
-#else
-#include <ni4882.h>
-#endif
+#include "gpibtransport.h"
 
 
 class GpibDevice : public QObject
@@ -37,10 +31,14 @@ public:
     explicit      GpibDevice(int gpio, int address, QObject *parent = Q_NULLPTR);
     virtual int    init();
     virtual void   onGpibCallback(int ud, unsigned long ibsta, unsigned long iberr, long ibcntl);
+    virtual bool   serviceRequest();
+    virtual void   onServiceRequest(char statusByte);
+    int            address() const;
 
 protected:
     uint    gpibWrite(int ud, QString sCmd);
     QString gpibRead(int ud);
+    bool    gpibRead(int ud, QByteArray &buffer);
     QString ErrMsg(int sta, int err, long cntl);
     bool    isGpibError(QString sErrorString);
 
@@ -55,13 +53,13 @@ public:
     const int NO_ERROR = 0;
 
 protected:
+    GpibTransport* pBus;
     QString sCommand;
     QString sResponse;
-    QTimer  pollTimer;
-    int     pollInterval;
     int     gpibNumber;
     int     gpibAddress;
     int     gpibId;
+    bool    bSrqEnabled;
     char    spollByte;
     int     iMask;
     char    readBuf[2001];
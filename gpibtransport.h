@@ -0,0 +1,89 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QtGlobal>
+
+#if defined(GPIB_EMULATOR_ONLY)
+#include "gpibconstants.h"
+#elif defined(Q_OS_LINUX)
+#include <gpib/ib.h>
+#else
+#include <ni4882.h>
+#endif
+
+
+// The bus the instruments are connected to.
+// Every GPIB call made by gfet goes through the process wide transport
+// so that the real hardware (LinuxGpibTransport) can be replaced by the
+// in-process Keithley 236 emulator (EmulatedGpibTransport).
+// The methods mirror the corresponding NI-488.2 calls: they return
+// the ibsta value and leave iberr and ibcnt available through
+// status(), error() and count() for the calling thread.
+class GpibTransport
+{
+public:
+    virtual ~GpibTransport();
+
+    static GpibTransport* instance();
+    static void           setInstance(GpibTransport* pTransport);
+
+public:
+    // Device level calls
+    virtual int  openDevice(int board, int pad, int sad, int tmo, int eot, int eos) = 0; // ibdev()
+    virtual int  setOnline(int ud, int v) = 0;                                            // ibonl()
+    virtual int  clearDevice(int ud) = 0;                                                 // ibclr()
+    virtual int  isListener(int board, int pad, int sad, short *listen) = 0;              // ibln()
+    virtual int  write(int ud, const char *data, long count) = 0;                         // ibwrt()
+    virtual int  read(int ud, char *buffer, long count) = 0;                              // ibrd()
+    virtual int  serialPoll(int ud, char *result) = 0;                                    // ibrsp()
+    virtual int  trigger(int ud) = 0;                                                     // ibtrg()
+    virtual int  readAsync(int ud, char *buffer, long count) = 0;                         // ibrda()
+    virtual int  stop(int ud) = 0;                                                        // ibstop()
+
+    // Device or board level calls (board descriptor = board index)
+    virtual int  wait(int ud, int mask) = 0;                                              // ibwait()
+    virtual int  setTimeout(int ud, int tmo) = 0;                                         // ibtmo()
+
+    // Board level calls
+    virtual void sendIFC(int board) = 0;                                                  // SendIFC()
+    virtual int  configure(int board, int option, int value) = 0;                         // ibconfig()
+    virtual void devClearList(int board, const Addr4882_t *addrList) = 0;                 // DevClearList()
+    virtual void devClear(int board, Addr4882_t address) = 0;                             // DevClear()
+    virtual void findListeners(int board, const Addr4882_t *padList,
+                               Addr4882_t *resultList, int limit) = 0;                    // FindLstn()
+    virtual void send(int board, Addr4882_t address,
+                      const void *data, long count, int eotMode) = 0;                     // Send()
+    virtual void receive(int board, Addr4882_t address,
+                         void *buffer, long count, int termination) = 0;                  // Receive()
+    virtual void findRequester(int board, const Addr4882_t *addrList, short *result) = 0; // FindRQS()
+    virtual void allSerialPoll(int board, const Addr4882_t *addrList,
+                               short *resultList) = 0;                                    // AllSpoll()
+    virtual void triggerList(int board, const Addr4882_t *addrList) = 0;                  // TriggerList()
+
+    // Results of the last call made by the calling thread
+    virtual int  status() = 0;
+    virtual int  error() = 0;
+    virtual long count() = 0;
+
+    virtual bool isEmulated() const = 0;
+
+private:
+    static GpibTransport* pInstance;
+};
@@ -0,0 +1,110 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "gpibworker.h"
+
+#include <QMutexLocker>
+#include <QSemaphore>
+
+
+GpibWorker::GpibWorker(int iBoard, QObject *parent)
+    : QObject(parent)
+    , gpibBoard(iBoard)
+{
+    pThread = new QThread();
+    pThread->setObjectName(QString("GPIB%1").arg(gpibBoard));
+    moveToThread(pThread);
+    pThread->start(QThread::TimeCriticalPriority);
+}
+
+
+// The devices must have already been deleted (see call())
+GpibWorker::~GpibWorker() {
+    clear();
+    pThread->quit();
+    pThread->wait();
+    delete pThread;
+}
+
+
+int
+GpibWorker::board() const {
+    return gpibBoard;
+}
+
+
+// The device (and its children, timers included) will live
+// in the acquisition thread. It must not have a parent.
+void
+GpibWorker::adopt(QObject *pDevice) {
+    pDevice->moveToThread(pThread);
+}
+
+
+void
+GpibWorker::post(const Command &command, Priority priority) {
+    QMutexLocker locker(&queueMutex);
+    commandQueue[priority].enqueue(command);
+    QMetaObject::invokeMethod(this, "processQueue", Qt::QueuedConnection);
+}
+
+
+// Execute the command in the acquisition thread
+// waiting for its completion
+void
+GpibWorker::call(const Command &command) {
+    if(QThread::currentThread() == pThread) {
+        command();
+        return;
+    }
+    QSemaphore done;
+    post([&command, &done]() {
+        command();
+        done.release();
+    }, HighPriority);
+    done.acquire();
+}
+
+
+// Drop the commands not yet started (the high priority
+// ones are kept: a call() may be waiting for them)
+void
+GpibWorker::clear() {
+    QMutexLocker locker(&queueMutex);
+    commandQueue[LowPriority].clear();
+    commandQueue[NormalPriority].clear();
+}
+
+
+// A single command for each posted event, so that the
+// instrument timers run in between the commands
+void
+GpibWorker::processQueue() {
+    Command command;
+    {
+        QMutexLocker locker(&queueMutex);
+        for(int i=HighPriority; i>=LowPriority; i--) {
+            if(!commandQueue[i].isEmpty()) {
+                command = commandQueue[i].dequeue();
+                break;
+            }
+        }
+    }
+    if(command)
+        command();
+}
@@ -0,0 +1,64 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QQueue>
+#include <functional>
+
+
+// The acquisition thread of a GPIB board.
+// The instruments on the board live in this thread: all their
+// I/O is executed here, one command at a time, taking first the
+// highest priority ones. The results come back with the
+// instrument signals (queued to the receiver thread).
+class GpibWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority {
+        LowPriority    = 0,
+        NormalPriority = 1,
+        HighPriority   = 2
+    };
+    typedef std::function<void()> Command;
+
+public:
+    explicit GpibWorker(int iBoard, QObject *parent = Q_NULLPTR);
+    ~GpibWorker();
+
+public:
+    int  board() const;
+    void adopt(QObject *pDevice);
+    void post(const Command &command, Priority priority=NormalPriority);
+    void call(const Command &command);
+    void clear();
+
+private slots:
+    void processQueue();
+
+private:
+    int             gpibBoard;
+    QThread        *pThread;
+    QMutex          queueMutex;
+    QQueue<Command> commandQueue[HighPriority+1];
+};
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "idstab.h"
 #include "mainwindow.h"
+#include "keithley236.h"
 
 #include <QLineEdit>
 #include <QLabel>
@@ -39,6 +40,8 @@ IDSTab::IDSTab(QWidget *parent)
     , nSweepPointsMax(500)
     , intervalMin(0.1)
     , intervalMax(600.0)
+    , pulseOffMin(5)
+    , pulseOffMax(65000)
 {
     // Build the Tab layout
     QGridLayout* pLayout = new QGridLayout();
@@ -46,6 +49,8 @@ IDSTab::IDSTab(QWidget *parent)
     pLayout->addWidget(&StopLabel,                   2, 0, 1, 1);
     pLayout->addWidget(new QLabel("Rdgs Intv [ms]"), 4, 0, 1, 1);
     pLayout->addWidget(new QLabel("N°of Points"),    5, 0, 1, 1);
+    pLayout->addWidget(new QLabel("Sweep Shape"),    6, 0, 1, 1);
+    pLayout->addWidget(new QLabel("Pulse Off [ms]"), 7, 0, 1, 1);
     pLayout->addWidget(&StartLabel,      1, 0, 1, 1);
     pLayout->addWidget(&ComplianceLabel, 3, 0, 1, 1);
     //Line Edits
@@ -54,6 +59,12 @@ IDSTab::IDSTab(QWidget *parent)
     pLayout->addWidget(&StopEdit,        2, 1, 1, 1);
     pLayout->addWidget(&WaitTimeEdit,    4, 1, 1, 1);
     pLayout->addWidget(&SweepPointsEdit, 5, 1, 1, 1);
+    pLayout->addWidget(&SweepShapeCombo, 6, 1, 1, 1);
+    pLayout->addWidget(&PulseOffEdit,    7, 1, 1, 1);
+    pLayout->addWidget(new QLabel("Segments [V:N]"), 8, 0, 1, 1);
+    pLayout->addWidget(&SegmentsEdit,    8, 1, 1, 1);
+    pLayout->addWidget(new QLabel("Acquisition"), 9, 0, 1, 1);
+    pLayout->addWidget(&AcquisitionCombo, 9, 1, 1, 1);
     // Set the Layout
     setLayout(pLayout);
 
@@ -65,6 +76,19 @@ IDSTab::IDSTab(QWidget *parent)
     sErrorStyle += "selection-background-color: rgb(128, 128, 255);";
     sErrorStyle += "}";
 
+    // In the order of Keithley236::AcquisitionPreset
+    AcquisitionCombo.addItem("Fast");
+    AcquisitionCombo.addItem("Balanced");
+    AcquisitionCombo.addItem("Low Noise");
+    AcquisitionCombo.addItem("Auto");
+
+    // In the order of Keithley236::SweepShape
+    SweepShapeCombo.addItem("Linear");
+    SweepShapeCombo.addItem("Logarithmic");
+    SweepShapeCombo.addItem("Pulsed Linear");
+    SweepShapeCombo.addItem("Pulsed Logarithmic");
+    SweepShapeCombo.addItem("Custom Segments");
+
     connectSignals();
     restoreSettings();
     initUI();
@@ -80,6 +104,10 @@ IDSTab::restoreSettings() {
     iWaitTime     = settings.value("IDSTabWaitTime", 100).toInt();
     iNSweepPoints = settings.value("IDSTabSweepPoints", 100).toInt();
     dInterval     = settings.value("IDSTabMeasureInterval", 0.1).toDouble();
+    iAcquisition  = settings.value("IDSTabAcquisition", Keithley236::LowNoiseAcquisition).toInt();
+    iSweepShape   = settings.value("IDSTabSweepShape", Keithley236::LinearStair).toInt();
+    iPulseOff     = settings.value("IDSTabPulseOff", 100).toInt();
+    sSegments     = settings.value("IDSTabSegments", "").toString();
     dStep = (dStop-dStart) / iNSweepPoints;
 }
 
@@ -93,6 +121,10 @@ IDSTab::saveSettings() {
     settings.setValue("IDSTabWaitTime",    iWaitTime);
     settings.setValue("IDSTabSweepPoints", iNSweepPoints);
     settings.setValue("IDSTabMeasureInterval", dInterval);
+    settings.setValue("IDSTabAcquisition", iAcquisition);
+    settings.setValue("IDSTabSweepShape",  iSweepShape);
+    settings.setValue("IDSTabPulseOff",    iPulseOff);
+    settings.setValue("IDSTabSegments",    sSegments);
 }
 
 
@@ -107,6 +139,14 @@ IDSTab::setToolTips() {
     WaitTimeEdit.setToolTip(sHeader.arg(waitTimeMin).arg(waitTimeMax));
     SweepPointsEdit.setToolTip((sHeader.arg(nSweepPointsMin).arg(nSweepPointsMax)));
     MeasureIntervalEdit.setToolTip(sHeader.arg(intervalMin).arg(intervalMax));
+    AcquisitionCombo.setToolTip("Reading filter and integration time:\n"
+                                "Auto chooses them from the last readings");
+    SweepShapeCombo.setToolTip("Logarithmic sweeps are dense near 0V\n"
+                               "Pulsed sweeps return to 0V between points\n"
+                               "Custom sweeps are made of the listed Segments");
+    PulseOffEdit.setToolTip(sHeader.arg(pulseOffMin).arg(pulseOffMax));
+    SegmentsEdit.setToolTip("Linear segments from V Start: \"V:N; V:N; ...\"\n"
+                            "each one reaches V in N steps");
 }
 
 
@@ -137,6 +177,17 @@ IDSTab::initUI() {
         dInterval = intervalMin;
     }
     MeasureIntervalEdit.setText(QString("%1").arg(dInterval, 0, 'f', 2));
+    if((iAcquisition < 0) || (iAcquisition >= AcquisitionCombo.count()))
+        iAcquisition = Keithley236::LowNoiseAcquisition;
+    AcquisitionCombo.setCurrentIndex(iAcquisition);
+    if((iSweepShape < 0) || (iSweepShape >= SweepShapeCombo.count()))
+        iSweepShape = Keithley236::LinearStair;
+    SweepShapeCombo.setCurrentIndex(iSweepShape);
+    if(!isPulseOffValid(iPulseOff))
+        iPulseOff = 100;
+    PulseOffEdit.setText(QString("%1").arg(iPulseOff));
+    SegmentsEdit.setText(sSegments);
+    enableShapeEdits();
     setToolTips();
 }
 
@@ -155,6 +206,14 @@ IDSTab::connectSignals() {
             this, SLOT(onSweepPointsEdit_textChanged(const QString)));
     connect(&MeasureIntervalEdit, SIGNAL(textChanged(const QString)),
             this, SLOT(onMeasureIntervalEdit_textChanged(const QString)));
+    connect(&AcquisitionCombo, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(onAcquisitionCombo_currentIndexChanged(int)));
+    connect(&SweepShapeCombo, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(onSweepShapeCombo_currentIndexChanged(int)));
+    connect(&PulseOffEdit, SIGNAL(textChanged(const QString)),
+            this, SLOT(onPulseOffEdit_textChanged(const QString)));
+    connect(&SegmentsEdit, SIGNAL(textChanged(const QString)),
+            this, SLOT(onSegmentsEdit_textChanged(const QString)));
 }
 
 
@@ -198,6 +257,43 @@ IDSTab::isIntervalValid(double interval) {
 }
 
 
+bool
+IDSTab::isPulseOffValid(int iPulseOff) {
+    return (iPulseOff >= pulseOffMin) && (iPulseOff <= pulseOffMax);
+}
+
+
+bool
+IDSTab::isSegmentListValid(const QString &sList, double *pLastVoltage) {
+    QVector<double> stops;
+    QVector<int> intervals;
+    if(!Keithley236::parseSegments(sList, stops, intervals))
+        return false;
+    for(int i=0; i<stops.count(); i++) {
+        if(!isVoltageValid(stops.at(i)))
+            return false;
+    }
+    *pLastVoltage = stops.last();
+    return true;
+}
+
+
+// The Pulse Off time is used only by the pulsed sweeps and the
+// Segments only by the custom ones, whose V Stop is the end of the
+// last segment
+void
+IDSTab::enableShapeEdits() {
+    bool bCustom = (iSweepShape == Keithley236::CustomStair);
+    PulseOffEdit.setEnabled((iSweepShape == Keithley236::PulsedStair) ||
+                            (iSweepShape == Keithley236::PulsedLogStair));
+    SegmentsEdit.setEnabled(bCustom);
+    StopEdit.setEnabled(!bCustom);
+    double dLast;
+    if(bCustom && isSegmentListValid(sSegments, &dLast))
+        StopEdit.setText(QString("%1").arg(dLast));
+}
+
+
 void
 IDSTab::onStartEdit_textChanged(const QString &arg1) {
     double dTemp = arg1.toDouble();
@@ -281,3 +377,42 @@ IDSTab::onMeasureIntervalEdit_textChanged(const QString &arg1) {
 }
 
 
+void
+IDSTab::onSweepShapeCombo_currentIndexChanged(int index) {
+    iSweepShape = index;
+    enableShapeEdits();
+}
+
+
+void
+IDSTab::onPulseOffEdit_textChanged(const QString &arg1) {
+    int iTemp = arg1.toInt();
+    if(isPulseOffValid(iTemp)) {
+        iPulseOff = iTemp;
+        PulseOffEdit.setStyleSheet(sNormalStyle);
+    }
+    else {
+        PulseOffEdit.setStyleSheet(sErrorStyle);
+    }
+}
+
+
+void
+IDSTab::onSegmentsEdit_textChanged(const QString &arg1) {
+    double dLast;
+    if(isSegmentListValid(arg1, &dLast)) {
+        sSegments = arg1;
+        SegmentsEdit.setStyleSheet(sNormalStyle);
+        if(iSweepShape == Keithley236::CustomStair)
+            StopEdit.setText(QString("%1").arg(dLast));
+    }
+    else {
+        SegmentsEdit.setStyleSheet(sErrorStyle);
+    }
+}
+
+
+void
+IDSTab::onAcquisitionCombo_currentIndexChanged(int index) {
+    iAcquisition = index;
+}
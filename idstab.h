@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QLineEdit>
 #include <QRadioButton>
 #include <QLabel>
+#include <QComboBox>
 
 
 class IDSTab : public QWidget
@@ -42,6 +43,10 @@ public slots:
     void onWaitTimeEdit_textChanged(const QString &arg1);
     void onSweepPointsEdit_textChanged(const QString &arg1);
     void onMeasureIntervalEdit_textChanged(const QString &arg1);
+    void onAcquisitionCombo_currentIndexChanged(int index);
+    void onSweepShapeCombo_currentIndexChanged(int index);
+    void onPulseOffEdit_textChanged(const QString &arg1);
+    void onSegmentsEdit_textChanged(const QString &arg1);
 
 protected:
     void setToolTips();
@@ -54,6 +59,9 @@ protected:
     bool isWaitTimeValid(int iWaitTime);
     bool isSweepPointNumberValid(int nSweepPoints);
     bool isIntervalValid(double interval);
+    bool isPulseOffValid(int iPulseOff);
+    bool isSegmentListValid(const QString &sList, double *pLastVoltage);
+    void enableShapeEdits();
 
 public:
     double dStart;
@@ -63,6 +71,10 @@ public:
     int    iWaitTime;
     int    iNSweepPoints;
     double dInterval;
+    int    iAcquisition; // Keithley236::AcquisitionPreset
+    int    iSweepShape; // Keithley236::SweepShape
+    int    iPulseOff;   // [ms] Pulsed sweeps only
+    QString sSegments;  // "V:N; V:N; ..." Custom sweeps only
 
 private:
     // Limit Values
@@ -76,6 +88,8 @@ private:
     const int    nSweepPointsMax;
     const double intervalMin;
     const double intervalMax;
+    const int    pulseOffMin;
+    const int    pulseOffMax;
 
     // QLineEdit styles
     QString sNormalStyle;
@@ -93,5 +107,9 @@ private:
     QLineEdit    WaitTimeEdit;
     QLineEdit    SweepPointsEdit;
     QLineEdit    MeasureIntervalEdit;
+    QComboBox    AcquisitionCombo;
+    QComboBox    SweepShapeCombo;
+    QLineEdit    PulseOffEdit;
+    QLineEdit    SegmentsEdit;
 };
 
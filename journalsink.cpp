@@ -0,0 +1,280 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "journalsink.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+
+JournalSink::JournalSink()
+    : pFile(nullptr)
+    , bCompressed(false)
+    , resumeStep(0)
+{
+}
+
+
+JournalSink::~JournalSink() {
+    delete pFile;
+}
+
+
+QString
+JournalSink::journalFileName(const QString &sBaseDir, const QString &sFileName) {
+    QFileInfo fileInfo(sFileName);
+    return QString("%1/%2.gfj").arg(sBaseDir, fileInfo.baseName());
+}
+
+
+bool
+JournalSink::openRun(const RunInfo &info) {
+    resumeStep = info.resumeStep;
+    pFile = new QFile(journalFileName(info.sBaseDir, info.sFileName));
+    if(resumeStep > 0) {
+        // The journal goes on in its own format
+        bCompressed = BlockFileReader::isBlockFile(pFile->fileName());
+        if(!pFile->open(QIODevice::ReadWrite)) {
+            sError = QString("Unable to Open Journal %1").arg(pFile->fileName());
+            return false;
+        }
+        QByteArray sText;
+        if(bCompressed) {
+            if(!blockWriter.open(pFile, true)) {
+                sError = blockWriter.errorString();
+                return false;
+            }
+            sText += "\n"; // Lost blocks may have cut a line
+        }
+        else if(pFile->size() > 0) { // The last line may have been left unterminated
+            pFile->seek(pFile->size()-1);
+            if(pFile->read(1) != "\n")
+                sText += "\n";
+            pFile->seek(pFile->size());
+        }
+        sText += QString("# Resumed %1 at Step %2\n")
+                 .arg(info.startTime.toString())
+                 .arg(resumeStep).toLocal8Bit();
+        return writeBytes(sText) && flush(true);
+    }
+    bCompressed = info.bCompressed;
+    if(!pFile->open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+        sError = QString("Unable to Open Journal %1").arg(pFile->fileName());
+        return false;
+    }
+    if(bCompressed && !blockWriter.open(pFile, false)) {
+        sError = blockWriter.errorString();
+        return false;
+    }
+    QStringList config;
+    config << QString("Measure=%1").arg(info.iMeasure)
+           << QString("FileName=%1").arg(info.sFileName)
+           << QString("SampleInfo=%1").arg(escape(info.sSampleInfo))
+           << QString("StartTime=%1").arg(info.startTime.toString(Qt::ISODate))
+           << info.parameters;
+    QString sText = QString("# gfet Run Journal\n");
+    for(int i=0; i<config.count(); i++)
+        sText += QString("C %1\n").arg(config.at(i));
+    return writeBytes(sText.toUtf8()) && flush(true);
+}
+
+
+bool
+JournalSink::openStep(int iStep, double stepValue) {
+    if(isReplayed(iStep))
+        return true;
+    char sLine[64];
+    qsnprintf(sLine, sizeof(sLine), "S %d %.17g\n", iStep, stepValue);
+    return writeBytes(QByteArray(sLine));
+}
+
+
+bool
+JournalSink::write(int iStep, const RunPoint *pPoints, int nPoints) {
+    if(isReplayed(iStep))
+        return true;
+    char sLine[192];
+    buffer.resize(0);
+    for(int i=0; i<nPoints; i++) {
+        const RunPoint &point = pPoints[i];
+        qsnprintf(sLine, sizeof(sLine), "P %d %.17g %.17g %.17g %.17g %lld %d\n",
+                  iStep, point.vg, point.ig, point.vds, point.ids,
+                  static_cast<long long>(point.timestamp), point.nReadings);
+        buffer.append(sLine);
+    }
+    return writeBytes(buffer);
+}
+
+
+// A compressed journal gets a (short) block at every flush
+bool
+JournalSink::flush(bool bSync) {
+    if(bCompressed && !blockWriter.flush()) {
+        sError = blockWriter.errorString();
+        return false;
+    }
+    if(!(bSync ? syncFile(pFile) : pFile->flush())) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+// A step is complete only when it is on the disk
+bool
+JournalSink::closeStep(int iStep, bool bSync) {
+    Q_UNUSED(bSync)
+    if(isReplayed(iStep))
+        return true;
+    if(!writeBytes(QString("E %1\n").arg(iStep).toLocal8Bit()))
+        return false;
+    return flush(true);
+}
+
+
+bool
+JournalSink::closeRun() {
+    if(!pFile || !pFile->isOpen())
+        return true;
+    bool bDone = flush(true);
+    if(bDone && bCompressed && !blockWriter.close()) {
+        sError = blockWriter.errorString();
+        bDone = false;
+    }
+    pFile->close();
+    return bDone;
+}
+
+
+bool
+JournalSink::isReplayed(int iStep) const {
+    return iStep < resumeStep;
+}
+
+
+bool
+JournalSink::writeBytes(const QByteArray &data) {
+    if(bCompressed) {
+        if(!blockWriter.write(data)) {
+            sError = blockWriter.errorString();
+            return false;
+        }
+        return true;
+    }
+    if(pFile->write(data) != data.size()) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+// The configuration values stay on a single line
+QString
+JournalSink::escape(QString sText) {
+    return sText.replace("\\", "\\\\").replace("\n", "\\n");
+}
+
+
+QString
+JournalSink::unescape(const QString &sText) {
+    QString sResult;
+    for(int i=0; i<sText.length(); i++) {
+        if((sText.at(i) == '\\') && (i+1 < sText.length())) {
+            i++;
+            sResult += (sText.at(i) == 'n') ? QChar('\n') : sText.at(i);
+        }
+        else
+            sResult += sText.at(i);
+    }
+    return sResult;
+}
+
+
+// The malformed lines are skipped: only the steps
+// with their "E" record are complete
+bool
+JournalSink::read(const QString &sJournal, RunJournal &journal, QString &sError) {
+    QByteArray text;
+    if(BlockFileReader::isBlockFile(sJournal)) {
+        BlockFileReader reader;
+        if(!reader.open(sJournal)) {
+            sError = reader.errorString();
+            return false;
+        }
+        text = reader.readAll();
+    }
+    else {
+        QFile file(sJournal);
+        if(!file.open(QIODevice::ReadOnly)) {
+            sError = QString("Unable to Open Journal %1").arg(sJournal);
+            return false;
+        }
+        text = file.readAll();
+    }
+    QList<QByteArray> lines = text.split('\n');
+    lines.removeLast(); // Empty or unterminated
+    journal.config.clear();
+    journal.steps.clear();
+    for(int i=0; i<lines.count(); i++) {
+        const QByteArray &line = lines.at(i);
+        if(line.startsWith("C ")) {
+            QString sItem = QString::fromUtf8(line.mid(2));
+            int iEqual = sItem.indexOf('=');
+            if(iEqual > 0)
+                journal.config.insert(sItem.left(iEqual), unescape(sItem.mid(iEqual+1)));
+            continue;
+        }
+        QList<QByteArray> fields = line.split(' ');
+        bool bOk = true;
+        int iStep = (fields.count() > 1) ? fields.at(1).toInt(&bOk) : 0;
+        if(!bOk || (iStep < 1))
+            continue;
+        if((fields.at(0) == "S") && (fields.count() == 3)) {
+            RunJournal::Step &step = journal.steps[iStep];
+            step.step      = iStep;
+            step.stepValue = fields.at(2).toDouble(&bOk);
+            step.points.clear();
+            step.bComplete = false;
+            if(!bOk)
+                journal.steps.remove(iStep);
+        }
+        else if((fields.at(0) == "P") && (fields.count() == 8) && journal.steps.contains(iStep)) {
+            RunPoint point;
+            bool bGood = true;
+            point.vg        = fields.at(2).toDouble(&bOk); bGood &= bOk;
+            point.ig        = fields.at(3).toDouble(&bOk); bGood &= bOk;
+            point.vds       = fields.at(4).toDouble(&bOk); bGood &= bOk;
+            point.ids       = fields.at(5).toDouble(&bOk); bGood &= bOk;
+            point.timestamp = fields.at(6).toLongLong(&bOk); bGood &= bOk;
+            point.nReadings = fields.at(7).toInt(&bOk); bGood &= bOk;
+            if(bGood)
+                journal.steps[iStep].points.append(point);
+        }
+        else if((fields.at(0) == "E") && (fields.count() == 2) && journal.steps.contains(iStep)) {
+            journal.steps[iStep].bComplete = true;
+        }
+    }
+    if(!journal.config.contains("Measure")) {
+        sError = QString("%1 is not a gfet Run Journal").arg(sJournal);
+        return false;
+    }
+    return true;
+}
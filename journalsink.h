@@ -0,0 +1,86 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include "runwriter.h"
+#include "blockfile.h"
+
+#include <QMap>
+#include <QByteArray>
+
+
+// What a run journal tells of the run
+struct RunJournal
+{
+    struct Step {
+        int               step;
+        double            stepValue;
+        QVector<RunPoint> points;
+        bool              bComplete; // Closed and forced to the disk
+    };
+    QMap<QString, QString> config;   // "Measure", "FileName", "SampleInfo", "StartTime"
+                                     // and the RunInfo parameters
+    QMap<int, Step>        steps;
+};
+
+
+// The crash safe record of the run, <name>.gfj: an append only
+// text file with a record per line,
+//     C <name>=<value>    the configuration of the run
+//     S <step> <value>    a step (re)started: its previous points are void
+//     P <step> <vg> <ig> <vds> <ids> <timestamp> <nReadings>
+//     E <step>            the step is complete
+// and '#' comments. The file is forced to the disk (fsync) at the
+// end of every step, whatever the DurabilityPolicy, and an
+// unterminated last line (a crash while writing) is ignored.
+// When compressed (RunInfo::bCompressed) the lines are a BlockFileWriter
+// stream, with a block at every flush.
+// A resumed run (RunInfo::resumeStep > 0) is appended to its journal:
+// the steps before resumeStep, replayed from the journal, are skipped.
+class JournalSink : public RunSink
+{
+public:
+    JournalSink();
+    ~JournalSink();
+
+public:
+    bool openRun(const RunInfo &info);
+    bool openStep(int iStep, double stepValue);
+    bool write(int iStep, const RunPoint *pPoints, int nPoints);
+    bool flush(bool bSync);
+    bool closeStep(int iStep, bool bSync);
+    bool closeRun();
+
+public:
+    static QString journalFileName(const QString &sBaseDir, const QString &sFileName);
+    static bool    read(const QString &sJournal, RunJournal &journal, QString &sError);
+
+private:
+    bool       isReplayed(int iStep) const;
+    bool       writeBytes(const QByteArray &data);
+    static QString escape(QString sText);
+    static QString unescape(const QString &sText);
+
+private:
+    QFile          *pFile;
+    bool            bCompressed;
+    BlockFileWriter blockWriter;
+    int             resumeStep;
+    QByteArray      buffer;
+};
@@ -0,0 +1,755 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "k236emulator.h"
+
+#include <QtMath>
+#include <QList>
+
+
+#define MAX_SWEEP_POINTS 1000
+
+// Bits of the U1X error status word
+#define ERR_TRIGGER_OVERRUN 0   // (as warning)
+#define ERR_INVALID_SWEEP   9
+#define ERR_IDDCO           24
+#define ERR_IDDC            25
+
+
+const qint64 K236Emulator::byteTime;
+const qint64 K236Emulator::commandTime;
+const qint64 K236Emulator::readingOverhead;
+const qint64 K236Emulator::autorangeTime;
+const qint64 K236Emulator::rangeChangeTime;
+const qint64 K236Emulator::clearTime;
+
+
+namespace k236emulator {
+static const qint64 integrationTime[4] = {416, 4000, 16667, 20000}; // [us]
+static const int    logPoints[4]       = {5, 10, 25, 50};         // Points per decade
+
+static double
+argument(const QList<double> &args, int i, double currentValue) {
+    if(i >= args.count() || qIsNaN(args.at(i)))
+        return currentValue;
+    return args.at(i);
+}
+}
+
+
+GFetModel::GFetModel()
+    : rContact(800.0)
+    , rPeak(6000.0)
+    , vDirac(8.0)
+    , peakWidth(6.0)
+    , rLeakage(5.0e11)
+    , tauGate(400000.0)
+{
+    GateStep step;
+    step.t  = 0;
+    step.vg = 0.0;
+    gateHistory.append(step);
+}
+
+
+void
+GFetModel::setGateVoltage(double vg, qint64 t) {
+    if(gateHistory.last().vg == vg)
+        return;
+    GateStep step;
+    step.t  = t;
+    step.vg = vg;
+    int i = gateHistory.count();
+    while((i > 1) && (gateHistory.at(i-1).t > t))
+        i--;
+    gateHistory.insert(i, step);
+    while(gateHistory.count() > 4096)
+        gateHistory.removeFirst();
+}
+
+
+// Replay the gate steps: after each step the gate voltage "seen"
+// by the channel relaxes toward the applied value.
+double
+GFetModel::gateVoltage(qint64 t) const {
+    double vEff = gateHistory.first().vg;
+    int k = 0;
+    for(; (k+1 < gateHistory.count()) && (gateHistory.at(k+1).t <= t); k++) {
+        double dt = double(gateHistory.at(k+1).t - gateHistory.at(k).t);
+        vEff = gateHistory.at(k).vg + (vEff - gateHistory.at(k).vg)*qExp(-dt/tauGate);
+    }
+    double dt = qMax(0.0, double(t - gateHistory.at(k).t));
+    return gateHistory.at(k).vg + (vEff - gateHistory.at(k).vg)*qExp(-dt/tauGate);
+}
+
+
+double
+GFetModel::channelResistance(qint64 t) const {
+    double x = (gateVoltage(t) - vDirac) / peakWidth;
+    return rContact + rPeak/qSqrt(1.0 + x*x);
+}
+
+
+double
+GFetModel::drainCurrent(double vds, qint64 t) const {
+    return vds / channelResistance(t);
+}
+
+
+double
+GFetModel::drainVoltage(double ids, qint64 t) const {
+    return ids * channelResistance(t);
+}
+
+
+double
+GFetModel::gateCurrent(double vg) const {
+    return vg / rLeakage;
+}
+
+
+double
+GFetModel::gateVoltageFromCurrent(double ig) const {
+    return ig * rLeakage;
+}
+
+
+K236Emulator::K236Emulator(int address, GFetModel *pSample, bool bDrivesGate)
+    : gpibAddress(address)
+    , pSample(pSample)
+    , bGate(bDrivesGate)
+    , pTriggerTarget(nullptr)
+    , generator(std::mt19937::result_type(address))
+{
+    setDefaults();
+    busyUntil = 0;
+}
+
+
+void
+K236Emulator::setDefaults() {
+    sourceFunction   = 0;
+    dcFunction       = 0;
+    biasLevel        = 0.0;
+    biasRange        = 0;
+    biasDelay        = 0.0;
+    complianceLevel  = 1.0e-3;
+    complianceRange  = 0;
+    outputItems      = 4;
+    outputFormat     = 0;
+    outputLines      = 0;
+    srqMask          = 0;
+    complianceSelect = 0;
+    bArmed           = false;
+    bOperate         = false;
+    triggerOrigin    = 0;
+    triggerIn        = 0;
+    triggerOut       = 0;
+    triggerEnd       = 0;
+    filterCode       = 0;
+    integrationCode  = 0;
+    sweepList.clear();
+
+    commandBuffer.clear();
+    outputBuffer.clear();
+    statusOutput.clear();
+    lastOutput.clear();
+    sweepData.clear();
+    bMeasuring    = false;
+    measureStart  = 0;
+    measureEnd    = 0;
+    sweepIndex    = 0;
+    lastRange     = 0;
+    appliedSource = 0.0;
+    bReadingDone  = false;
+    bSweepDone    = false;
+    bCompliance   = false;
+    bTriggerOut   = false;
+    errorWord     = 0;
+    warningWord   = 0;
+    lastStatus    = 0;
+    bSrqPending   = false;
+    pendingTriggers.clear();
+}
+
+
+int
+K236Emulator::address() const {
+    return gpibAddress;
+}
+
+
+// Device Clear (SDC or DCL): return to the power-on defaults
+void
+K236Emulator::clear(qint64 now) {
+    setDefaults();
+    applySource(0.0, now);
+    busyUntil = now + clearTime;
+}
+
+
+// Bytes sent by the controller: commands are buffered
+// and executed when the X character is received
+void
+K236Emulator::listen(const QByteArray &data, qint64 now) {
+    update(now);
+    for(int i=0; i<data.size(); i++) {
+        char c = data.at(i);
+        if((c >= 'a') && (c <= 'z'))
+            c = char(c - 'a' + 'A');
+        if(c == 'X')
+            executeCommands(now);
+        else if((c != ' ') && (c != '\r') && (c != '\n'))
+            commandBuffer.append(c);
+    }
+}
+
+
+void
+K236Emulator::executeCommands(qint64 now) {
+    qint64 start = qMax(now, busyUntil);
+    int nCommands = 0;
+    bool bImmediateTrigger = false;
+    int i = 0;
+    while(i < commandBuffer.size()) {
+        char cCommand = commandBuffer.at(i++);
+        if((cCommand < 'A') || (cCommand > 'Z')) {
+            setError(ERR_IDDC);
+            continue;
+        }
+        // The parameters end at the next command letter
+        // ('E' is never a command: it is a number exponent)
+        int iStart = i;
+        while((i < commandBuffer.size()) &&
+              (((commandBuffer.at(i) < 'A') || (commandBuffer.at(i) > 'Z')) ||
+               (commandBuffer.at(i) == 'E')))
+            i++;
+        QList<double> args;
+        QByteArray sParameters = commandBuffer.mid(iStart, i-iStart);
+        if(!sParameters.isEmpty()) {
+            QList<QByteArray> sArgs = sParameters.split(',');
+            for(int j=0; j<sArgs.count(); j++) {
+                bool bOk;
+                double value = sArgs.at(j).toDouble(&bOk);
+                args.append(bOk ? value : qQNaN());
+            }
+        }
+        if((cCommand == 'H') && (int(k236emulator::argument(args, 0, 0.0)) == 0))
+            bImmediateTrigger = true;
+        else
+            execute(cCommand, args, start + nCommands*commandTime);
+        nCommands++;
+    }
+    commandBuffer.clear();
+    busyUntil = start + nCommands*commandTime;
+    if(bImmediateTrigger && bArmed && !bMeasuring)
+        startMeasure(busyUntil);
+}
+
+
+void
+K236Emulator::execute(char cCommand, const QList<double> &args, qint64 t) {
+    switch(cCommand) {
+    case 'B': // Bias: level, range, delay
+        biasLevel = k236emulator::argument(args, 0, biasLevel);
+        biasRange = int(k236emulator::argument(args, 1, biasRange));
+        biasDelay = k236emulator::argument(args, 2, biasDelay);
+        if(bOperate && (dcFunction == 0) && (!bArmed || (triggerIn == 0)))
+            applySource(biasLevel, t);
+        break;
+    case 'F': // Function: source, dc/sweep
+        sourceFunction = int(k236emulator::argument(args, 0, sourceFunction));
+        dcFunction     = int(k236emulator::argument(args, 1, dcFunction));
+        break;
+    case 'G': // Output data format: items, format, lines
+        outputItems  = int(k236emulator::argument(args, 0, outputItems));
+        outputFormat = int(k236emulator::argument(args, 1, outputFormat));
+        outputLines  = int(k236emulator::argument(args, 2, outputLines));
+        break;
+    case 'L': // Compliance: level, measure range
+        complianceLevel = qAbs(k236emulator::argument(args, 0, complianceLevel));
+        complianceRange = int(k236emulator::argument(args, 1, complianceRange));
+        break;
+    case 'M': // SRQ mask, compliance select
+        srqMask          = int(k236emulator::argument(args, 0, srqMask));
+        complianceSelect = int(k236emulator::argument(args, 1, complianceSelect));
+        lastStatus = 0; // Conditions already true will request service
+        break;
+    case 'N': // Operate
+        bOperate = int(k236emulator::argument(args, 0, 0.0)) != 0;
+        applySource((bOperate && (dcFunction == 0)) ? biasLevel : 0.0, t);
+        break;
+    case 'P': // Filter
+        filterCode = qBound(0, int(k236emulator::argument(args, 0, filterCode)), 5);
+        break;
+    case 'Q': // Sweep
+        programSweep(int(k236emulator::argument(args, 0, 1.0)), args.mid(1));
+        break;
+    case 'R': // Trigger control
+        bArmed = int(k236emulator::argument(args, 0, 0.0)) != 0;
+        break;
+    case 'S': // Integration time
+        integrationCode = qBound(0, int(k236emulator::argument(args, 0, integrationCode)), 3);
+        break;
+    case 'T': // Trigger configuration: origin, in, out, end
+        triggerOrigin = int(k236emulator::argument(args, 0, triggerOrigin));
+        triggerIn     = int(k236emulator::argument(args, 1, triggerIn));
+        triggerOut    = int(k236emulator::argument(args, 2, triggerOut));
+        triggerEnd    = int(k236emulator::argument(args, 3, triggerEnd));
+        break;
+    case 'U': { // Status
+        int iStatus = int(k236emulator::argument(args, 0, 0.0));
+        if(iStatus == 0) {
+            statusOutput = "236A06\r\n";
+        }
+        else if(iStatus == 1) {
+            statusOutput = "ERS";
+            for(int i=25; i>=0; i--)
+                statusOutput.append((errorWord & (1u << i)) ? '1' : '0');
+            statusOutput.append("\r\n");
+            errorWord = 0;
+        }
+        else if(iStatus == 9) {
+            statusOutput = "WRS";
+            for(int i=9; i>=0; i--)
+                statusOutput.append((warningWord & (1u << i)) ? '1' : '0');
+            statusOutput.append("\r\n");
+            warningWord = 0;
+        }
+        else
+            setError(ERR_IDDCO);
+        break;
+    }
+    case 'A': case 'C': case 'D': case 'J': case 'K':
+    case 'O': case 'V': case 'W': case 'Y': case 'Z':
+        break; // Accepted but without effects on the model
+    default:
+        setError(ERR_IDDC);
+    }
+}
+
+
+void
+K236Emulator::programSweep(int iType, const QList<double> &args) {
+    if((iType < 0) || (iType > 11)) {
+        setError(ERR_IDDCO);
+        return;
+    }
+    if(iType < 6) // Create
+        sweepList.clear();
+    iType %= 6;   // Q6..Q11 append to the existing sweep
+    bool bPulsed = (iType >= 3);
+    SweepPoint point;
+    point.bPulsed = bPulsed;
+    point.delay   = 0.0;
+    point.tOff    = 0.0;
+    point.tOn     = 0.0;
+    QVector<double> levels;
+
+    double start = k236emulator::argument(args, 0, 0.0);
+    if((iType == 0) || (iType == 3)) { // Fixed level
+        // level, range, delay, count  -  level, range, pulses, toff, ton
+        int nPoints = int(k236emulator::argument(args, 2, 1.0));
+        if(iType == 0) {
+            point.delay = k236emulator::argument(args, 2, 0.0);
+            nPoints = int(k236emulator::argument(args, 3, 1.0));
+        }
+        for(int i=0; i<nPoints; i++)
+            levels.append(start);
+    }
+    else if((iType == 1) || (iType == 4)) { // Linear stair
+        double stop = k236emulator::argument(args, 1, start);
+        double step = qAbs(k236emulator::argument(args, 2, 0.0));
+        if(step == 0.0) {
+            setError(ERR_INVALID_SWEEP);
+            return;
+        }
+        int nPoints = int(qAbs(stop-start)/step + 1.0e-6) + 1;
+        double direction = (stop >= start) ? 1.0 : -1.0;
+        for(int i=0; (i<nPoints) && (i<=MAX_SWEEP_POINTS); i++)
+            levels.append(start + direction*i*step);
+    }
+    else { // Log stair
+        double stop = k236emulator::argument(args, 1, start);
+        int iPoints = qBound(0, int(k236emulator::argument(args, 2, 0.0)), 3);
+        if((start == 0.0) || (start*stop <= 0.0)) {
+            setError(ERR_INVALID_SWEEP);
+            return;
+        }
+        double nDecades = log10(stop/start);
+        int nPoints = int(qAbs(nDecades)*k236emulator::logPoints[iPoints] + 1.0e-6) + 1;
+        double direction = (nDecades >= 0.0) ? 1.0 : -1.0;
+        for(int i=0; (i<nPoints) && (i<=MAX_SWEEP_POINTS); i++)
+            levels.append(start*qPow(10.0, direction*i/k236emulator::logPoints[iPoints]));
+    }
+    if(bPulsed) {
+        int iFirst = (iType == 3) ? 3 : 4;
+        point.tOff = k236emulator::argument(args, iFirst,   0.0);
+        point.tOn  = k236emulator::argument(args, iFirst+1, 0.0);
+    }
+    else if(iType != 0) {
+        point.delay = k236emulator::argument(args, 4, 0.0);
+    }
+
+    for(int i=0; i<levels.count(); i++) {
+        if(sweepList.count() >= MAX_SWEEP_POINTS) {
+            setError(ERR_INVALID_SWEEP);
+            return;
+        }
+        point.level = levels.at(i);
+        sweepList.append(point);
+    }
+}
+
+
+// GET: honoured only when the trigger origin is GET
+void
+K236Emulator::trigger(qint64 now) {
+    update(now);
+    if(!bArmed || (triggerOrigin != 1))
+        return;
+    if(bMeasuring || (now < busyUntil)) {
+        setWarning(ERR_TRIGGER_OVERRUN);
+        update(now);
+        return;
+    }
+    startMeasure(now);
+}
+
+
+// The trigger link: our TRIGGER OUT pulses reach pTarget
+void
+K236Emulator::setTriggerLink(K236Emulator *pTarget) {
+    pTriggerTarget = pTarget;
+}
+
+
+// A TRIGGER IN pulse at time t (it may be in the future):
+// served when the instrument state is advanced past t
+void
+K236Emulator::externalTrigger(qint64 t) {
+    int i = pendingTriggers.count();
+    while((i > 0) && (pendingTriggers.at(i-1) > t))
+        i--;
+    pendingTriggers.insert(i, t);
+}
+
+
+// Trigger out phases (as the T command): 1 = after source,
+// 2 = after delay, 4 = after measure
+void
+K236Emulator::sendTriggerOut(int iPhase, qint64 t) {
+    if(pTriggerTarget && (triggerOut & iPhase))
+        pTriggerTarget->externalTrigger(t);
+}
+
+
+void
+K236Emulator::startMeasure(qint64 start) {
+    bMeasuring   = true;
+    measureStart = start;
+    bCompliance  = false;
+    if(dcFunction == 0) {
+        applySource(bOperate ? biasLevel : 0.0, start);
+        sendTriggerOut(1, start);
+        qint64 t = start + qint64(biasDelay*1000.0);
+        sendTriggerOut(2, t);
+        Reading reading = takeReading(appliedSource, t);
+        reading.delay = biasDelay;
+        reading.time  = double(t - start)*1.0e-6;
+        measureEnd = t + readingTime(reading.measure);
+        sendTriggerOut(4, measureEnd);
+        sweepData.clear();
+        sweepData.append(reading);
+        return;
+    }
+    // Sweep: all the points when the trigger input is continuous,
+    // otherwise a single point for each trigger
+    if(sweepIndex == 0)
+        sweepData.clear();
+    if(sweepList.isEmpty()) {
+        setError(ERR_INVALID_SWEEP);
+        bMeasuring = false;
+        return;
+    }
+    qint64 t = start;
+    int iLast = (triggerIn == 0) ? sweepList.count()-1 : sweepIndex;
+    for(; sweepIndex<=iLast; sweepIndex++) {
+        const SweepPoint &point = sweepList.at(sweepIndex);
+        applySource(bOperate ? point.level : 0.0, t);
+        sendTriggerOut(1, t);
+        qint64 tMeasure = t + qint64((point.bPulsed ? point.tOff : point.delay)*1000.0);
+        sendTriggerOut(2, tMeasure);
+        Reading reading = takeReading(appliedSource, tMeasure);
+        qint64 tDone = tMeasure + readingTime(reading.measure);
+        if(point.bPulsed)
+            tDone = qMax(tDone, tMeasure + qint64(point.tOn*1000.0));
+        sendTriggerOut(4, tDone);
+        reading.delay = point.delay;
+        reading.time  = double(tMeasure - measureStart)*1.0e-6;
+        sweepData.append(reading);
+        t = tDone;
+    }
+    measureEnd = t;
+}
+
+
+void
+K236Emulator::applySource(double level, qint64 t) {
+    appliedSource = level;
+    if(bGate && (sourceFunction == 0))
+        pSample->setGateVoltage(level, t);
+}
+
+
+K236Emulator::Reading
+K236Emulator::takeReading(double level, qint64 t) {
+    Reading reading;
+    reading.source      = level;
+    reading.bCompliance = false;
+    reading.bOverflow   = false;
+    if(sourceFunction == 0)
+        reading.measure = bGate ? pSample->gateCurrent(level) : pSample->drainCurrent(level, t);
+    else
+        reading.measure = bGate ? pSample->gateVoltageFromCurrent(level) : pSample->drainVoltage(level, t);
+
+    // Noise decreases with the number of readings averaged
+    int iRange = (complianceRange == 0) ? measureRange(reading.measure) : complianceRange;
+    double nPeriods = double((1 << filterCode) * k236emulator::integrationTime[integrationCode]) /
+                      double(k236emulator::integrationTime[3]);
+    double sigma = (2.0e-4*qAbs(reading.measure) + 1.0e-4*rangeFullScale(iRange)) / qSqrt(nPeriods);
+    std::normal_distribution<double> noise(0.0, sigma);
+    reading.measure += noise(generator);
+
+    if(qAbs(reading.measure) > complianceLevel) {
+        reading.measure = (reading.measure > 0.0) ? complianceLevel : -complianceLevel;
+        reading.bCompliance = true;
+    }
+    double fullScale = rangeFullScale(iRange);
+    if(qAbs(reading.measure) > 1.1*fullScale) {
+        reading.measure = (reading.measure > 0.0) ? 1.1*fullScale : -1.1*fullScale;
+        reading.bOverflow = true;
+    }
+    if(reading.bCompliance)
+        bCompliance = true;
+    return reading;
+}
+
+
+qint64
+K236Emulator::readingTime(double measured) {
+    qint64 t = (1 << filterCode) * (k236emulator::integrationTime[integrationCode] + readingOverhead);
+    if(complianceRange == 0) {
+        int iRange = measureRange(measured);
+        t += autorangeTime;
+        if(lastRange != 0)
+            t += rangeChangeTime * qAbs(iRange - lastRange);
+        lastRange = iRange;
+    }
+    return t;
+}
+
+
+// The lowest range able to measure the value
+int
+K236Emulator::measureRange(double value) const {
+    int nRanges = (sourceFunction == 0) ? 9 : 3;
+    for(int iRange=1; iRange<nRanges; iRange++)
+        if(qAbs(value) <= rangeFullScale(iRange))
+            return iRange;
+    return nRanges;
+}
+
+
+double
+K236Emulator::rangeFullScale(int iRange) const {
+    if(sourceFunction == 0) // Current ranges: 1nA .. 100mA
+        return 1.0e-9 * qPow(10.0, qBound(1, iRange, 9) - 1);
+    static const double voltageRange[3] = {1.1, 11.0, 110.0};
+    return voltageRange[qBound(1, iRange, 3) - 1];
+}
+
+
+QByteArray
+K236Emulator::formatValue(char cPrefix, const char *sKind, double value, bool bVolt) const {
+    QByteArray sValue;
+    if(outputFormat < 2) {
+        sValue.append(cPrefix);
+        sValue.append(sKind);
+        sValue.append(bVolt ? 'V' : 'I');
+    }
+    if(value >= 0.0)
+        sValue.append('+');
+    sValue.append(QByteArray::number(value, 'E', 4));
+    return sValue;
+}
+
+
+QByteArray
+K236Emulator::formatReading(const Reading &reading, bool bSweep) const {
+    QList<QByteArray> items;
+    const char *sSource  = bSweep ? "SSW" : "SDC";
+    const char *sMeasure = bSweep ? "MSW" : "MDC";
+    if(outputItems & 1)
+        items.append(formatValue('N', sSource, reading.source, sourceFunction == 0));
+    if(outputItems & 2)
+        items.append(formatValue('N', "DLY", reading.delay*1.0e-3, false));
+    if(outputItems & 4) {
+        char cPrefix = reading.bOverflow ? 'O' : (reading.bCompliance ? 'C' : 'N');
+        items.append(formatValue(cPrefix, sMeasure, reading.measure, sourceFunction != 0));
+    }
+    if(outputItems & 8)
+        items.append(formatValue('N', "TIM", reading.time, false));
+    QByteArray sReading;
+    for(int i=0; i<items.count(); i++) {
+        if(i > 0)
+            sReading.append(',');
+        sReading.append(items.at(i));
+    }
+    return sReading;
+}
+
+
+void
+K236Emulator::update(qint64 now) {
+    // TRIGGER IN pulses up to now (trigger origin External)
+    while(!pendingTriggers.isEmpty() && (pendingTriggers.first() <= now)) {
+        qint64 t = pendingTriggers.first();
+        pendingTriggers.removeFirst();
+        finishMeasure(t);
+        if(!bArmed || (triggerOrigin != 3))
+            continue;
+        if(bMeasuring || (t < busyUntil)) {
+            setWarning(ERR_TRIGGER_OVERRUN);
+            continue;
+        }
+        startMeasure(t);
+    }
+    finishMeasure(now);
+    int iStatus = statusByte(now);
+    if((iStatus & ~lastStatus) & srqMask)
+        bSrqPending = true;
+    lastStatus = iStatus;
+}
+
+
+void
+K236Emulator::finishMeasure(qint64 now) {
+    if(bMeasuring && (now >= measureEnd)) {
+        bMeasuring = false;
+        if(dcFunction == 0) {
+            outputBuffer = formatReading(sweepData.last(), false) + "\r\n";
+            bReadingDone = true;
+        }
+        else if(sweepIndex >= sweepList.count()) {
+            outputBuffer.clear();
+            for(int i=0; i<sweepData.count(); i++) {
+                if(i > 0)
+                    outputBuffer.append(',');
+                outputBuffer.append(formatReading(sweepData.at(i), true));
+            }
+            outputBuffer.append("\r\n");
+            sweepIndex = 0;
+            bSweepDone = true;
+            applySource(bOperate ? biasLevel : 0.0, measureEnd);
+        }
+    }
+}
+
+
+int
+K236Emulator::statusByte(qint64 now) {
+    int iStatus = 0;
+    if(warningWord)   iStatus |= WARNING;
+    if(bSweepDone)    iStatus |= SWEEP_DONE;
+    if(bTriggerOut)   iStatus |= TRIGGER_OUT;
+    if(bReadingDone)  iStatus |= READING_DONE;
+    if(bArmed && !bMeasuring && (now >= busyUntil))
+        iStatus |= READY_FOR_TRIGGER;
+    if(errorWord)     iStatus |= K236_ERROR;
+    if(bCompliance)   iStatus |= COMPLIANCE;
+    return iStatus;
+}
+
+
+QByteArray
+K236Emulator::talk(qint64 now) {
+    update(now);
+    QByteArray sOutput;
+    if(!statusOutput.isEmpty()) {
+        sOutput = statusOutput;
+        statusOutput.clear();
+    }
+    else if(!outputBuffer.isEmpty()) {
+        sOutput = outputBuffer;
+        lastOutput = outputBuffer;
+        outputBuffer.clear();
+        bReadingDone = false;
+        bSweepDone   = false;
+    }
+    else // The K236 repeats the last reading
+        sOutput = lastOutput;
+    update(now);
+    return sOutput;
+}
+
+
+// When something to say will be available (-1 = never)
+qint64
+K236Emulator::dataAvailableAt(qint64 now) {
+    update(now);
+    if(!statusOutput.isEmpty()) // Available once the U command has been executed
+        return qMax(now, busyUntil);
+    if(!outputBuffer.isEmpty())
+        return now;
+    if(bMeasuring)
+        return measureEnd;
+    if(!lastOutput.isEmpty())
+        return now;
+    return -1;
+}
+
+
+char
+K236Emulator::serialPoll(qint64 now) {
+    update(now);
+    int iStatus = lastStatus;
+    if(bSrqPending)
+        iStatus |= RQS_BIT;
+    bSrqPending = false;
+    return char(iStatus);
+}
+
+
+bool
+K236Emulator::isRequestingService(qint64 now) {
+    update(now);
+    return bSrqPending;
+}
+
+
+void
+K236Emulator::setError(int iBit) {
+    errorWord |= (1u << iBit);
+}
+
+
+void
+K236Emulator::setWarning(int iBit) {
+    warningWord |= (1u << iBit);
+}
@@ -0,0 +1,197 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <random>
+
+
+// A simple GFET connected to the two emulated K236:
+// the channel resistance has a peak at the Dirac point and the
+// gate voltage "seen" by the channel relaxes exponentially toward
+// the applied value (trapped charges) so that settling is visible.
+// All times are in microseconds.
+class GFetModel
+{
+public:
+    GFetModel();
+
+public:
+    void   setGateVoltage(double vg, qint64 t);
+    double gateVoltage(qint64 t) const;
+    double channelResistance(qint64 t) const;
+    double drainCurrent(double vds, qint64 t) const;
+    double drainVoltage(double ids, qint64 t) const;
+    double gateCurrent(double vg) const;
+    double gateVoltageFromCurrent(double ig) const;
+
+public:
+    double rContact;
+    double rPeak;
+    double vDirac;
+    double peakWidth;
+    double rLeakage;
+    double tauGate;
+
+private:
+    struct GateStep {
+        qint64 t;
+        double vg;
+    };
+    QList<GateStep> gateHistory;
+};
+
+
+// In-process model of a Keithley 236 Source Measure Unit.
+// It understands the subset of the K236 command set used by gfet
+// (B, F, G, H, L, M, N, O, P, Q, R, S, T, U, Z) and models the
+// time needed to process commands and to take readings.
+// The TRIGGER OUT of an instrument can be connected to the
+// TRIGGER IN of another one (trigger link).
+// The instrument is "lazy": its state is advanced to the requested
+// time every time the controller talks to it.
+class K236Emulator
+{
+public:
+    K236Emulator(int address, GFetModel *pSample, bool bDrivesGate);
+
+public:
+    int        address() const;
+    void       clear(qint64 now);
+    void       listen(const QByteArray &data, qint64 now);
+    QByteArray talk(qint64 now);
+    qint64     dataAvailableAt(qint64 now);
+    char       serialPoll(qint64 now);
+    bool       isRequestingService(qint64 now);
+    void       trigger(qint64 now);
+    void       externalTrigger(qint64 t);
+    void       setTriggerLink(K236Emulator *pTarget);
+
+public:
+    // Timing model (microseconds)
+    static const qint64 byteTime        = 50;    // GPIB handshake per byte
+    static const qint64 commandTime     = 2000;  // Execution of a single command
+    static const qint64 readingOverhead = 300;   // A/D conversion and math per reading
+    static const qint64 autorangeTime   = 3000;  // Autorange check per reading
+    static const qint64 rangeChangeTime = 10000; // Each range change when autoranging
+    static const qint64 clearTime       = 50000; // Device Clear
+
+    // Serial poll status byte
+    static const int WARNING           = 1;
+    static const int SWEEP_DONE        = 2;
+    static const int TRIGGER_OUT       = 4;
+    static const int READING_DONE      = 8;
+    static const int READY_FOR_TRIGGER = 16;
+    static const int K236_ERROR        = 32;
+    static const int RQS_BIT           = 64;
+    static const int COMPLIANCE        = 128;
+
+private:
+    struct SweepPoint {
+        double level;
+        double delay;   // [ms]
+        double tOn;     // [ms] (pulsed sweeps only)
+        double tOff;    // [ms] (pulsed sweeps only)
+        bool   bPulsed;
+    };
+    struct Reading {
+        double source;
+        double measure;
+        double delay;
+        double time;
+        bool   bCompliance;
+        bool   bOverflow;
+    };
+
+private:
+    void       setDefaults();
+    void       executeCommands(qint64 now);
+    void       execute(char cCommand, const QList<double> &args, qint64 now);
+    void       programSweep(int iType, const QList<double> &args);
+    void       update(qint64 now);
+    void       finishMeasure(qint64 now);
+    void       startMeasure(qint64 start);
+    void       sendTriggerOut(int iPhase, qint64 t);
+    void       applySource(double level, qint64 t);
+    Reading    takeReading(double level, qint64 t);
+    qint64     readingTime(double measured);
+    int        measureRange(double value) const;
+    double     rangeFullScale(int iRange) const;
+    QByteArray formatReading(const Reading &reading, bool bSweep) const;
+    QByteArray formatValue(char cPrefix, const char *sKind, double value, bool bVolt) const;
+    int        statusByte(qint64 now);
+    void       setError(int iBit);
+    void       setWarning(int iBit);
+
+private:
+    int          gpibAddress;
+    GFetModel   *pSample;
+    bool         bGate;
+    K236Emulator *pTriggerTarget; // Connected to our TRIGGER OUT
+    std::mt19937 generator;
+
+    // Instrument configuration
+    int    sourceFunction;  // 0 = Source V; 1 = Source I
+    int    dcFunction;      // 0 = DC; 1 = Sweep
+    double biasLevel;
+    int    biasRange;
+    double biasDelay;       // [ms]
+    double complianceLevel;
+    int    complianceRange; // 0 = Autorange
+    int    outputItems;
+    int    outputFormat;
+    int    outputLines;
+    int    srqMask;
+    int    complianceSelect;
+    bool   bArmed;
+    bool   bOperate;
+    int    triggerOrigin;
+    int    triggerIn;
+    int    triggerOut;
+    int    triggerEnd;
+    int    filterCode;
+    int    integrationCode;
+    QVector<SweepPoint> sweepList;
+
+    // Instrument state
+    QByteArray commandBuffer;
+    QByteArray outputBuffer;
+    QByteArray statusOutput;
+    QByteArray lastOutput;
+    QVector<Reading> sweepData;
+    bool   bMeasuring;
+    qint64 busyUntil;
+    qint64 measureStart;
+    qint64 measureEnd;
+    int    sweepIndex;
+    int    lastRange;
+    double appliedSource;
+    bool   bReadingDone;
+    bool   bSweepDone;
+    bool   bCompliance;
+    bool   bTriggerOut;
+    quint32 errorWord;
+    quint32 warningWord;
+    int    lastStatus;
+    bool   bSrqPending;
+    QVector<qint64> pendingTriggers; // TRIGGER IN pulses not yet served
+};
@@ -0,0 +1,276 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "k236parser.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <cmath>
+
+
+namespace k236parser {
+// Exactly representable: mantissa*10^e (or mantissa/10^e) is correctly
+// rounded for the 5 digits mantissae of the K236
+const double pow10[] = {
+    1.0e0,  1.0e1,  1.0e2,  1.0e3,  1.0e4,  1.0e5,  1.0e6,  1.0e7,
+    1.0e8,  1.0e9,  1.0e10, 1.0e11, 1.0e12, 1.0e13, 1.0e14, 1.0e15,
+    1.0e16, 1.0e17, 1.0e18, 1.0e19, 1.0e20, 1.0e21, 1.0e22
+};
+const int     maxPow10     = 22;
+const quint64 maxMantissa  = quint64(1) << 53;
+const int     maxDigits    = 19;
+
+
+inline bool
+isDigit(char c) {
+    return (c >= '0') && (c <= '9');
+}
+
+
+// Prefixes (e.g. "NSDCV"), separators and terminators are skipped
+inline bool
+isNumberStart(char c) {
+    return isDigit(c) || (c == '+') || (c == '-') || (c == '.');
+}
+
+
+QElapsedTimer
+startedClock() {
+    QElapsedTimer clock;
+    clock.start();
+    return clock;
+}
+}
+
+
+// Returns the position following the number or nullptr
+// if p does not point to a valid number
+const char*
+K236Parser::parseNumber(const char *p, const char *pEnd, double *pValue) {
+    using namespace k236parser;
+    bool bNegative = false;
+    if((*p == '+') || (*p == '-')) {
+        bNegative = (*p == '-');
+        p++;
+    }
+    quint64 mantissa = 0;
+    int nDigits = 0;
+    int exponent = 0;
+    bool bDigits = false;
+    for(; (p < pEnd) && isDigit(*p); p++) {
+        bDigits = true;
+        if(nDigits < maxDigits) {
+            mantissa = mantissa*10 + quint64(*p - '0');
+            if(mantissa) nDigits++;
+        }
+        else
+            exponent++;
+    }
+    if((p < pEnd) && (*p == '.')) {
+        p++;
+        for(; (p < pEnd) && isDigit(*p); p++) {
+            bDigits = true;
+            if(nDigits < maxDigits) {
+                mantissa = mantissa*10 + quint64(*p - '0');
+                if(mantissa) nDigits++;
+                exponent--;
+            }
+        }
+    }
+    if(!bDigits)
+        return nullptr;
+    if((p < pEnd) && ((*p == 'E') || (*p == 'e'))) {
+        p++;
+        bool bNegativeExp = false;
+        if((p < pEnd) && ((*p == '+') || (*p == '-'))) {
+            bNegativeExp = (*p == '-');
+            p++;
+        }
+        if((p >= pEnd) || !isDigit(*p))
+            return nullptr;
+        int e = 0;
+        for(; (p < pEnd) && isDigit(*p); p++) {
+            if(e < 10000)
+                e = e*10 + (*p - '0');
+        }
+        exponent += bNegativeExp ? -e : e;
+    }
+    double value = double(mantissa);
+    if((mantissa <= maxMantissa) && (exponent >= -maxPow10) && (exponent <= maxPow10)) {
+        if(exponent < 0)
+            value /= pow10[-exponent];
+        else
+            value *= pow10[exponent];
+    }
+    else // Very small (or not from a K236): extended precision
+        value = double(static_cast<long double>(mantissa) * std::pow(10.0L, exponent));
+    *pValue = bNegative ? -value : value;
+    return p;
+}
+
+
+// Returns the number of values stored or -1 on malformed data
+int
+K236Parser::parseValues(const char *pData, int nBytes, double *pValues, int maxValues) {
+    const char *p = pData;
+    const char *pEnd = pData + nBytes;
+    int nValues = 0;
+    while(nValues < maxValues) {
+        while((p < pEnd) && !k236parser::isNumberStart(*p))
+            p++;
+        if(p >= pEnd)
+            break;
+        p = parseNumber(p, pEnd, &pValues[nValues]);
+        if(!p)
+            return -1;
+        nValues++;
+    }
+    return nValues;
+}
+
+
+// Time stamp of the readings: nanoseconds from a monotonic clock
+qint64
+K236Parser::timestamp() {
+    static const QElapsedTimer clock = k236parser::startedClock();
+    return clock.nsecsElapsed();
+}
+
+
+// Decodes the complete Source,Measure pairs in pData[0..nBytes-1]:
+// the bytes used are returned in *pUsed (a truncated reading is left
+// for the next call). Returns the number of readings or -1 on
+// malformed data
+int
+K236Parser::parseReadings(const char *pData, int nBytes,
+                          K236Reading *pReadings, int maxReadings,
+                          qint64 timestamp, int *pUsed)
+{
+    const char *p = pData;
+    const char *pEnd = pData + nBytes;
+    int nReadings = 0;
+    *pUsed = 0;
+    while(nReadings < maxReadings) {
+        K236Reading &reading = pReadings[nReadings];
+        while((p < pEnd) && !k236parser::isNumberStart(*p))
+            p++;
+        if(p >= pEnd)
+            break;
+        p = parseNumber(p, pEnd, &reading.source);
+        if(!p)
+            return -1;
+        // The measure prefix (if any) tells Compliance and Overflow
+        reading.flags = 0;
+        while((p < pEnd) && ((*p == ',') || (*p == ' ')))
+            p++;
+        if((p < pEnd) && (*p == 'C'))
+            reading.flags |= K236Reading::Compliance;
+        else if((p < pEnd) && (*p == 'O'))
+            reading.flags |= K236Reading::Overflow;
+        while((p < pEnd) && !k236parser::isNumberStart(*p))
+            p++;
+        if(p >= pEnd)
+            break;
+        p = parseNumber(p, pEnd, &reading.measure);
+        if(!p)
+            return -1;
+        reading.timestamp = timestamp;
+        nReadings++;
+        *pUsed = int(p - pData);
+    }
+    return nReadings;
+}
+
+
+// Appends the readings in pData[0..nBytes-1] to the sweep
+int
+K236Parser::appendSweep(const char *pData, int nBytes,
+                        K236Sweep &sweep, qint64 timestamp, int *pUsed)
+{
+    int nValues = 1;
+    for(const char *p=pData; p<pData+nBytes; p++) {
+        if(*p == ',')
+            nValues++;
+    }
+    int nOld = sweep.size();
+    sweep.resize(nOld + nValues/2);
+    int nReadings = parseReadings(pData, nBytes,
+                                  sweep.data()+nOld, nValues/2,
+                                  timestamp, pUsed);
+    sweep.resize(nOld + qMax(nReadings, 0));
+    return nReadings;
+}
+
+
+// Sweep data are Source,Measure pairs. Returns the number of
+// readings or -1 on malformed data
+int
+K236Parser::parseSweep(const QByteArray &data, K236Sweep &sweep, qint64 timestamp) {
+    int nUsed;
+    sweep.resize(0);
+    return appendSweep(data.constData(), data.size(), sweep, timestamp, &nUsed);
+}
+
+
+// Parse time of a synthetic sweep of nPoints readings,
+// compared with the QString::split() and toDouble() decoding
+QString
+K236Parser::benchmark(int nPoints, int nRuns) {
+    QByteArray data;
+    for(int i=0; i<nPoints; i++) {
+        if(i > 0)
+            data.append(',');
+        double vds = -1.0 + 2.0*i/qMax(nPoints-1, 1);
+        double ids = 1.0e-3*vds + 1.0e-7*std::sin(double(i));
+        data.append(vds >= 0.0 ? "+" : "");
+        data.append(QByteArray::number(vds, 'E', 4));
+        data.append(',');
+        data.append(ids >= 0.0 ? "+" : "");
+        data.append(QByteArray::number(ids, 'E', 4));
+    }
+    data.append("\r\n");
+
+    K236Sweep sweep;
+    sweep.reserve(nPoints);
+    double check = 0.0;
+    QElapsedTimer timer;
+    timer.start();
+    for(int i=0; i<nRuns; i++) {
+        parseSweep(data, sweep, timestamp());
+        check += sweep.last().measure;
+    }
+    qint64 parserTime = timer.nsecsElapsed();
+
+    QString sData = QString::fromLatin1(data);
+    timer.start();
+    for(int i=0; i<nRuns; i++) {
+        QStringList sMeasures = sData.split(",");
+        for(int j=0; j<sMeasures.count()-1; j+=2) {
+            sweep[j/2].source  = sMeasures.at(j).toDouble();
+            sweep[j/2].measure = sMeasures.at(j+1).toDouble();
+        }
+        check -= sweep.last().measure;
+    }
+    qint64 splitTime = timer.nsecsElapsed();
+
+    return QString("%1 points sweep: parser %2 us/sweep, split()+toDouble() %3 us/sweep (check %4)")
+            .arg(nPoints)
+            .arg(double(parserTime)*1.0e-3/nRuns, 0, 'f', 1)
+            .arg(double(splitTime)*1.0e-3/nRuns, 0, 'f', 1)
+            .arg(check);
+}
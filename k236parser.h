@@ -0,0 +1,47 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+
+#include "k236reading.h"
+
+
+// Converts the ASCII output of the Keithley 236 (G5,2,2 and the like:
+// "+1.2345E-03,-6.7890E-06,...", with or without prefixes) straight
+// into K236Reading. No QString, no QStringList: once the sweep has
+// grown to its final length nothing is allocated any more.
+class K236Parser
+{
+public:
+    static qint64  timestamp();
+    static int     parseValues(const char *pData, int nBytes, double *pValues, int maxValues);
+    static int     parseReadings(const char *pData, int nBytes,
+                                 K236Reading *pReadings, int maxReadings,
+                                 qint64 timestamp, int *pUsed);
+    static int     appendSweep(const char *pData, int nBytes,
+                               K236Sweep &sweep, qint64 timestamp, int *pUsed);
+    static int     parseSweep(const QByteArray &data, K236Sweep &sweep, qint64 timestamp);
+    static QString benchmark(int nPoints=1000, int nRuns=1000);
+
+private:
+    static const char* parseNumber(const char *p, const char *pEnd, double *pValue);
+};
@@ -0,0 +1,46 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QtGlobal>
+#include <QVector>
+#include <QMetaType>
+
+
+// A reading of the Keithley 236, decoded once by the driver
+struct K236Reading
+{
+    enum Flag {
+        Compliance = 1, // "C" prefix or Compliance in the status byte
+        Overflow   = 2  // "O" prefix
+    };
+    double  source;
+    double  measure;
+    quint32 flags;
+    qint64  timestamp; // [ns] Monotonic: see K236Parser::timestamp()
+};
+Q_DECLARE_TYPEINFO(K236Reading, Q_PRIMITIVE_TYPE);
+
+
+// A sweep is a contiguous block of readings
+typedef QVector<K236Reading> K236Sweep;
+
+
+Q_DECLARE_METATYPE(K236Reading)
+Q_DECLARE_METATYPE(K236Sweep)
@@ -17,13 +17,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *
 */
 #include "keithley236.h"
+#include "k236parser.h"
 
 #include <QtMath>
 #include <QDateTime>
 #include <QThread>
+#include <QElapsedTimer>
 //#include <QDebug>
 
 #define MAX_COMPLIANCE_EVENTS 5
+#define READY_TIMEOUT         3000 // [ms]
+#define MAX_POLL_INTERVAL     20   // [ms]
+#define SWEEP_READING_SIZE    24   // [bytes] "+1.2345E-03,+1.2345E-03,"
+#define MAX_SWEEP_POINTS      1000 // Size of the K236 sweep buffer
+#define SWEEP_CHUNK           2400 // [bytes] About 100 readings
+#define LOG_SWEEP_DECADES     3    // Span of the logarithmic sweeps
+// Automatic acquisition
+#define AUTO_FAST_LEVEL       1.0e-6 // [A] Above: no filter, 4ms integration
+#define AUTO_BALANCED_LEVEL   1.0e-8 // [A] Above: 4 readings filter
+#define AUTO_NOISE_HIGH       1.0e-2 // Relative scatter of consecutive readings
+#define AUTO_NOISE_LOW        1.0e-4
+#define RANGE_HEADROOM        3.0    // Full scale / last reading of the predicted range
 
 namespace keithley236 {
 static int  rearmMask;
@@ -49,47 +63,69 @@ Keithley236::Keithley236(int gpio, int address, QObject *parent)
     , COMPLIANCE(128)
     //
     , isSweeping(false)
+    , triggerTimeoutTime(3000)
+    , bTriggerPending(false)
+    , acquisitionPreset(LowNoiseAcquisition)
+    , filterCode(5)
+    , integrationCode(3)
+    , lastMeasure(0.0)
+    , measureNoise(0.0)
+    , nMeasures(0)
+    , bPredictRange(true)
+    , bRangeKnown(false)
+    , bRangeOverflow(false)
+    , measuredFunction(0)
+    , lastMaxMeasure(0.0)
+    , fixedFunction(0)
+    , fixedRange(0)
+    , fixedCompliance(0.0)
+    , sourceFunction(0)
+    , sourceLevel(0.0)
+    , sweepMaxMeasure(0.0)
+    , bSweepOverflow(false)
 {
     iComplianceEvents = 0;
-    pollInterval = 569;
+    readingBuffer.reserve(64); // Memory kept from reading to reading
+    triggerTimer.setParent(this); // Follow the device in its thread
+    triggerTimer.setTimerType(Qt::PreciseTimer);
+    triggerTimer.setInterval(5);
+    connect(&triggerTimer, SIGNAL(timeout()),
+            this, SLOT(onTriggerPoll()));
 }
 
 
 Keithley236::~Keithley236() {
     if(gpibId != -1) {
 #if defined(Q_OS_LINUX)
-        pollTimer.stop();
-        pollTimer.disconnect();
+        bSrqEnabled = false;
 #else
         ibnotify(gpibId, 0, NULL, NULL);// disable notification
 #endif
-        ibonl(gpibId, 0);// Disable hardware and software.
+        pBus->setOnline(gpibId, 0);// Disable hardware and software.
     }
 }
 
 
 int
 Keithley236::init() {
-    gpibId = ibdev(gpibNumber, gpibAddress, 0, T3s, 1, 0);
+    gpibId = pBus->openDevice(gpibNumber, gpibAddress, 0, T3s, 1, 0);
     if(gpibId < 0) {
-        QString sError = ErrMsg(ThreadIbsta(), ThreadIberr(), ThreadIbcntl());
+        QString sError = ErrMsg(pBus->status(), pBus->error(), pBus->count());
         emit sendMessage(Q_FUNC_INFO + sError);
         return GPIB_DEVICE_NOT_PRESENT;
     }
     short listen;
-    ibln(gpibNumber, gpibAddress, NO_SAD, &listen);
+    pBus->isListener(gpibNumber, gpibAddress, NO_SAD, &listen);
     if(isGpibError(QString(Q_FUNC_INFO) + "Keithley 236 Not Respondig"))
         return GPIB_DEVICE_NOT_PRESENT;
     if(listen == 0) {
-        ibonl(gpibId, 0);
+        pBus->setOnline(gpibId, 0);
         emit sendMessage("Nolistener at Addr");
         return GPIB_DEVICE_NOT_PRESENT;
     }
     // set up the asynchronous event notification routine on RQS
 #if defined(Q_OS_LINUX)
-    connect(&pollTimer, SIGNAL(timeout()),
-            this, SLOT(checkNotify()));
-    pollTimer.start(pollInterval);
+    bSrqEnabled = true; // Serviced by the SRQ dispatcher of the board
 #else
     ibnotify(gpibId,
              RQS,
@@ -98,15 +134,173 @@ Keithley236::init() {
     if(isGpibError(QString(Q_FUNC_INFO) + "ibnotify call failed."))
         return -1;
 #endif
-    ibclr(gpibId);
-    QThread::sleep(1);
+    pBus->clearDevice(gpibId);
+    forgetSettings();
+    if(!waitForIdle()) {
+        emit sendMessage(QString(Q_FUNC_INFO) + "Keithley 236 not ready after Device Clear");
+        return GPIB_DEVICE_NOT_PRESENT;
+    }
     return NO_ERROR;
 }
 
 
+// Reading filter and integration time of the following measures.
+// Presets trade speed for noise; in automatic mode they are chosen
+// at every source change from the magnitude and the scatter of the
+// last readings: large currents use a short integration and only the
+// small (noisy) ones pay for the heavy filtering.
+void
+Keithley236::setAcquisition(int iPreset) {
+    acquisitionPreset = iPreset;
+    switch(iPreset) {
+    case FastAcquisition:
+        filterCode      = 0; // 1 Reading
+        integrationCode = 1; // 4ms
+        break;
+    case BalancedAcquisition:
+        filterCode      = 3; // 8 Readings
+        integrationCode = 3; // 20ms
+        break;
+    case AutoAcquisition:
+        lastMeasure  = 0.0;
+        measureNoise = 0.0;
+        nMeasures    = 0;
+        chooseAcquisition();
+        break;
+    default: // LowNoiseAcquisition
+        filterCode      = 5; // 32 Readings
+        integrationCode = 3; // 20ms
+        break;
+    }
+}
+
+
+void
+Keithley236::chooseAcquisition() {
+    if(acquisitionPreset != AutoAcquisition)
+        return;
+    if(nMeasures == 0) { // Nothing known yet: be careful
+        filterCode      = 5;
+        integrationCode = 3;
+        return;
+    }
+    double dAbs = qAbs(lastMeasure);
+    if(dAbs >= AUTO_FAST_LEVEL) {
+        filterCode      = 0;
+        integrationCode = 1;
+    }
+    else if(dAbs >= AUTO_BALANCED_LEVEL) {
+        filterCode      = 2;
+        integrationCode = 3;
+    }
+    else {
+        filterCode      = 5;
+        integrationCode = 3;
+    }
+    // The scatter of the readings has the last word
+    if((nMeasures > 1) && (measureNoise > AUTO_NOISE_HIGH))
+        filterCode = qMin(filterCode+2, 5);
+    else if((nMeasures > 1) && (measureNoise < AUTO_NOISE_LOW))
+        filterCode = qMax(filterCode-1, 0);
+}
+
+
+// Fixed measure ranges are predicted from the last readings (or the
+// last sweep) to spare the autorange time of every reading. After an
+// overflow the measure is autoranged until a good reading arrives.
+void
+Keithley236::setRangePrediction(bool bEnable) {
+    bPredictRange = bEnable;
+    bRangeKnown   = false;
+}
+
+
+// Measure range of the compliance command (0 = Autorange)
+int
+Keithley236::selectRange(int iFunction, double dCompliance, bool bZeroSource) {
+    fixedFunction   = iFunction;
+    fixedCompliance = dCompliance;
+    fixedRange      = 0;
+    if(bRangeOverflow)
+        return fixedRange;
+    if(bZeroSource) { // Nothing to measure: lowest range
+        fixedRange = 1;
+        return fixedRange;
+    }
+    if(!bPredictRange || !bRangeKnown || (measuredFunction != iFunction))
+        return fixedRange;
+    int nRanges = (iFunction == 0) ? 9 : 3;
+    for(int iRange=1; iRange<=nRanges; iRange++) {
+        if(lastMaxMeasure*RANGE_HEADROOM <= rangeFullScale(iFunction, iRange)) {
+            fixedRange = iRange;
+            break;
+        }
+    }
+    return fixedRange;
+}
+
+
+// Full scale of the measure ranges: 1nA..100mA when sourcing V,
+// 1.1V..110V when sourcing I
+double
+Keithley236::rangeFullScale(int iFunction, int iRange) const {
+    if(iFunction == 0)
+        return 1.0e-9 * qPow(10.0, qBound(1, iRange, 9) - 1);
+    static const double voltageRange[3] = {1.1, 11.0, 110.0};
+    return voltageRange[qBound(1, iRange, 3) - 1];
+}
+
+
+bool
+Keithley236::isOverRange(K236Reading &reading) const {
+    if(fixedRange == 0)
+        return false;
+    double fullScale = rangeFullScale(fixedFunction, fixedRange);
+    if(qAbs(reading.measure) >= fullScale)
+        reading.flags |= K236Reading::Overflow;
+    // The range limits the compliance too
+    bool bRangeLimited = (reading.flags & K236Reading::Compliance) &&
+                         (fullScale < qAbs(fixedCompliance));
+    return (reading.flags & K236Reading::Overflow) || bRangeLimited;
+}
+
+
+void
+Keithley236::rememberMeasure(int iFunction, double dMaxMeasure) {
+    measuredFunction = iFunction;
+    lastMaxMeasure   = dMaxMeasure;
+    bRangeKnown      = true;
+    if(fixedRange == 0)
+        bRangeOverflow = false;
+}
+
+
+void
+Keithley236::setSource(int iFunction, double dLevel) {
+    sourceFunction = iFunction;
+    sourceLevel    = dLevel;
+}
+
+
+QString
+Keithley236::filterSetting() const {
+    return QString("P%1").arg(filterCode);
+}
+
+
+QString
+Keithley236::integrationSetting() const {
+    return QString("S%1").arg(integrationCode);
+}
+
+
 int
 Keithley236::initVvsTSourceI(double dAppliedCurrent, double dCompliance) {
     iComplianceEvents = 0;
+    chooseAcquisition();
+    if(isSourceConfigured(1))
+        return updateSource(1, dAppliedCurrent, dCompliance);
+    forgetSettings();
     uint iErr = 0;
     iErr |= gpibWrite(gpibId, "M0,0");      // SRQ Disabled, SRQ on Compliance
     iErr |= gpibWrite(gpibId, "R0");        // Disarm Trigger
@@ -115,16 +309,14 @@ Keithley236::initVvsTSourceI(double dAppliedCurrent, double dCompliance) {
     iErr |= gpibWrite(gpibId, "F1,1X");     // Place for a moment in Source I Measure V Sweep Mode
     // For some reason the Compliance command does not
     // works when in Source I Measure V dc condition
-    int iScale = 0;
-    if(dAppliedCurrent == 0.0) {
-        iScale = 1;
-    }
+    int iScale = selectRange(1, dCompliance, dAppliedCurrent == 0.0);
+    setSource(1, dAppliedCurrent);
     sCommand = QString("L%1,%2X").arg(dCompliance).arg(iScale);
-    iErr |= gpibWrite(gpibId, sCommand);    // Set Compliance, Autorange Measure
+    iErr |= gpibWrite(gpibId, sCommand);    // Set Compliance, Measure Range
     iErr |= gpibWrite(gpibId, "G5,2,0");    // Output Source, Measure, No Prefix, DC
     iErr |= gpibWrite(gpibId, "Z0");        // Disable suppression
-    iErr |= gpibWrite(gpibId, "P5");        // 32 Reading Filter
-    iErr |= gpibWrite(gpibId, "S3");        // 20ms integration time
+    iErr |= gpibWrite(gpibId, filterSetting());      // Reading Filter
+    iErr |= gpibWrite(gpibId, integrationSetting()); // Integration time
     iErr |= gpibWrite(gpibId, "F1,0");      // Place in Source I Measure V
     sCommand = QString("B%1,0,0X").arg(dAppliedCurrent);
     iErr |= gpibWrite(gpibId, sCommand);    // Set Applied Current
@@ -133,13 +325,11 @@ Keithley236::initVvsTSourceI(double dAppliedCurrent, double dCompliance) {
     if(iErr & ERR) {
         QString sError;
         sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
-                .arg(ThreadIbsta(), 4, 16, QChar('0'));
-        sError += ErrMsg(ThreadIbsta(), ThreadIberr(), ThreadIbcntl());
+                .arg(pBus->status(), 4, 16, QChar('0'));
+        sError += ErrMsg(pBus->status(), pBus->error(), pBus->count());
         emit sendMessage(sError);
         return -1;
     }
-    // Give the instrument time to execute commands
-    QThread::sleep(1);
     int srqMask =
             COMPLIANCE +
             K236_ERROR +
@@ -150,6 +340,19 @@ Keithley236::initVvsTSourceI(double dAppliedCurrent, double dCompliance) {
     gpibWrite(gpibId, sCommand);   // SRQ Mask, Interrupt on Compliance
     if(isGpibError(QString(QString(Q_FUNC_INFO) + "%1").arg(sCommand)))
         exit(-1);
+    // Wait until the instrument has executed the commands
+    if(!waitForStatus(READY_FOR_TRIGGER, READY_TIMEOUT)) {
+        emit sendMessage(QString(Q_FUNC_INFO) + "Timeout waiting Ready for Trigger");
+        return -1;
+    }
+    rememberSettings(QStringList()
+                     << "O1" << "T1,1,0,0" << "G5,2,0" << "Z0"
+                     << filterSetting() << integrationSetting()
+                     << QString("L%1,%2").arg(dCompliance).arg(iScale)
+                     << "F1,0"
+                     << QString("B%1,0,0").arg(dAppliedCurrent)
+                     << "R1" << "N1"
+                     << QString("M%1,0").arg(srqMask));
     return NO_ERROR;
 }
 
@@ -157,6 +360,10 @@ Keithley236::initVvsTSourceI(double dAppliedCurrent, double dCompliance) {
 int
 Keithley236::initSourceV(double dAppliedVoltage, double dCompliance) {
     iComplianceEvents = 0;
+    chooseAcquisition();
+    if(isSourceConfigured(0))
+        return updateSource(0, dAppliedVoltage, dCompliance);
+    forgetSettings();
     uint iErr = 0;
     iErr |= gpibWrite(gpibId, "M0,0");      // SRQ Disabled, SRQ on Compliance
     iErr |= gpibWrite(gpibId, "R0");        // Disarm Trigger
@@ -165,16 +372,15 @@ Keithley236::initSourceV(double dAppliedVoltage, double dCompliance) {
     iErr |= gpibWrite(gpibId, "F0,1X");     // Place for a moment in Source V Measure I Sweep Mode
     // For some reason the Compliance command does not
     // works when in Source I Measure V dc condition
-    int iScale = 0;
-    if(dAppliedVoltage == 0.0)
-        iScale = 1;
+    int iScale = selectRange(0, dCompliance, dAppliedVoltage == 0.0);
+    setSource(0, dAppliedVoltage);
     sCommand = QString("L%1,%2X").arg(dCompliance).arg(iScale);
-    iErr |= gpibWrite(gpibId, sCommand);    // Set Compliance, Autorange Measure
+    iErr |= gpibWrite(gpibId, sCommand);    // Set Compliance, Measure Range
     iErr |= gpibWrite(gpibId, "F0,0");      // Source V Measure I dc
     iErr |= gpibWrite(gpibId, "G5,2,0");    // Output Source, Measure, No Prefix, DC
     iErr |= gpibWrite(gpibId, "Z0");        // Disable Zero suppression
-    iErr |= gpibWrite(gpibId, "P5");        // 32 Reading Filter
-    iErr |= gpibWrite(gpibId, "S3");        // 20ms integration time
+    iErr |= gpibWrite(gpibId, filterSetting());      // Reading Filter
+    iErr |= gpibWrite(gpibId, integrationSetting()); // Integration time
     sCommand = QString("B%1,0,0X").arg(dAppliedVoltage);
     iErr |= gpibWrite(gpibId, sCommand);    // Set Applied Current
     iErr |= gpibWrite(gpibId, "R1");        // Arm Trigger
@@ -182,13 +388,11 @@ Keithley236::initSourceV(double dAppliedVoltage, double dCompliance) {
     if(iErr & ERR) {
         QString sError;
         sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
-                .arg(ThreadIbsta(), 4, 16, QChar('0'));
-        sError += ErrMsg(ThreadIbsta(), ThreadIberr(), ThreadIbcntl());
+                .arg(pBus->status(), 4, 16, QChar('0'));
+        sError += ErrMsg(pBus->status(), pBus->error(), pBus->count());
         emit sendMessage(sError);
         return -1;
     }
-    // Give the instrument time to execute commands
-    QThread::sleep(1);
     int srqMask =
             COMPLIANCE +
             K236_ERROR +
@@ -199,28 +403,45 @@ Keithley236::initSourceV(double dAppliedVoltage, double dCompliance) {
     gpibWrite(gpibId, sCommand);   // SRQ Mask, Interrupt on Compliance
     if(isGpibError(QString(QString(Q_FUNC_INFO) + "%1").arg(sCommand)))
         exit(-1);
+    // Wait until the instrument has executed the commands
+    if(!waitForStatus(READY_FOR_TRIGGER, READY_TIMEOUT)) {
+        emit sendMessage(QString(Q_FUNC_INFO) + "Timeout waiting Ready for Trigger");
+        return -1;
+    }
+    rememberSettings(QStringList()
+                     << "O1" << "T1,1,0,0" << "G5,2,0" << "Z0"
+                     << filterSetting() << integrationSetting()
+                     << QString("L%1,%2").arg(dCompliance).arg(iScale)
+                     << "F0,0"
+                     << QString("B%1,0,0").arg(dAppliedVoltage)
+                     << "R1" << "N1"
+                     << QString("M%1,0").arg(srqMask));
     return NO_ERROR;
 }
 
 
 int
 Keithley236::standBy() {
-    gpibWrite(gpibId, "N0X");        // Place in Stand By
+    if(gpibWrite(gpibId, "N0X") & ERR) // Place in Stand By
+        forgetSettings();
+    else
+        rememberSettings(QStringList() << "N0");
     return NO_ERROR;
 }
 
 
 int
 Keithley236::endMeasure() {
+    cancelTrigger();
 #if defined(Q_OS_LINUX)
-    pollTimer.stop();
-    pollTimer.disconnect();
+    bSrqEnabled = false;
 #else
     ibnotify(gpibId, 0, NULL, NULL);// disable notification
 #endif
     gpibWrite(gpibId, "M0,0X");      // SRQ Disabled, SRQ on Compliance
     gpibWrite(gpibId, "R0");         // Disarm Trigger
     gpibWrite(gpibId, "N0X");        // Place in Stand By
+    forgetSettings();
     return NO_ERROR;
 }
 
@@ -231,15 +452,19 @@ Keithley236::initISweep(double startCurrent,
                         double currentStep,
                         double delay,
                         double voltageCompliance) {
+    forgetSettings();
+    reserveSweep(startCurrent, stopCurrent, qMax(currentStep, 1.0e-13));
     uint iErr = 0;
     iErr |= gpibWrite(gpibId, "M0,0X");    // SRQ Disabled, SRQ on Compliance
     iErr |= gpibWrite(gpibId, "F1,1");     // Source I, Sweep mode
     iErr |= gpibWrite(gpibId, "O1");       // Remote Sense
     iErr |= gpibWrite(gpibId, "T1,0,0,0"); // Trigger on GET, Continuous
-    sCommand = QString("L%1,0X").arg(voltageCompliance);
-    iErr |= gpibWrite(gpibId, sCommand);   // Set Compliance, Autorange Measure
+    sCommand = QString("L%1,%2X").arg(voltageCompliance).arg(selectRange(1, voltageCompliance));
+    iErr |= gpibWrite(gpibId, sCommand);   // Set Compliance, Measure Range
     iErr |= gpibWrite(gpibId, "G5,2,2");   // Output Source and Measure, No Prefix, All Lines Sweep Data
     iErr |= gpibWrite(gpibId, "Z0");       // Disable suppression
+    iErr |= gpibWrite(gpibId, filterSetting());      // Reading Filter
+    iErr |= gpibWrite(gpibId, integrationSetting()); // Integration time
     sCommand = QString("Q1,%1,%2,%3,0,%4X")
             .arg(startCurrent)
             .arg(stopCurrent)
@@ -249,8 +474,8 @@ Keithley236::initISweep(double startCurrent,
     if(iErr & ERR) {
         QString sError;
         sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
-                .arg(ThreadIbsta(), 4, 16, QChar('0'));
-        sError += ErrMsg(ThreadIbsta(), ThreadIberr(), ThreadIbcntl());
+                .arg(pBus->status(), 4, 16, QChar('0'));
+        sError += ErrMsg(pBus->status(), pBus->error(), pBus->count());
         emit sendMessage(sError);
         return false;
     }
@@ -259,8 +484,8 @@ Keithley236::initISweep(double startCurrent,
     if(iErr & ERR) {
         QString sError;
         sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
-                .arg(ThreadIbsta(), 4, 16, QChar('0'));
-        sError += ErrMsg(ThreadIbsta(), ThreadIberr(), ThreadIbcntl());
+                .arg(pBus->status(), 4, 16, QChar('0'));
+        sError += ErrMsg(pBus->status(), pBus->error(), pBus->count());
         emit sendMessage(sError);
         return false;
     }
@@ -273,32 +498,413 @@ Keithley236::initISweep(double startCurrent,
 }
 
 
+// Read and decode a dc reading (Source,Measure)
 bool
-Keithley236::initVSweep(double startVoltage,
-                        double stopVoltage,
-                        double voltageStep,
-                        double delay,
-                        double currentCompliance) {
+Keithley236::readReading(K236Reading &reading) {
+    qint64 timestamp = K236Parser::timestamp();
+    if(!gpibRead(gpibId, readingBuffer))
+        return false;
+    int nUsed;
+    if(K236Parser::parseReadings(readingBuffer.constData(), readingBuffer.size(),
+                                 &reading, 1, timestamp, &nUsed) != 1)
+    {
+        emit sendMessage(QString(Q_FUNC_INFO) + "Measurement Format Error");
+        return false;
+    }
+    if((fixedRange > 0) &&
+       (qAbs(reading.measure) >= rangeFullScale(fixedFunction, fixedRange)))
+        reading.flags |= K236Reading::Overflow; // No prefixes in the output
+    if(!(reading.flags & K236Reading::Overflow)) { // For the automatic acquisition
+        double dAbs = qMax(qAbs(reading.measure), qAbs(lastMeasure));
+        if((nMeasures > 0) && (dAbs > 0.0))
+            measureNoise = qAbs(reading.measure-lastMeasure) / dAbs;
+        lastMeasure = reading.measure;
+        nMeasures++;
+    }
+    return true;
+}
+
+
+// Size the sweep buffers once for all the sweeps of a measure
+void
+Keithley236::reserveSweep(double dStart, double dStop, double dStep) {
+    int nPoints = MAX_SWEEP_POINTS;
+    if(qAbs(dStep) > 0.0)
+        nPoints = int(qMin(qAbs(dStop-dStart)/qAbs(dStep), double(MAX_SWEEP_POINTS))) + 1;
+    if(sweepBuffer.capacity() < nPoints*SWEEP_READING_SIZE)
+        sweepBuffer.reserve(nPoints*SWEEP_READING_SIZE);
+    if(sweepData.capacity() < nPoints)
+        sweepData.reserve(nPoints);
+}
+
+
+// Read the sweep data (Source,Measure pairs) with asynchronous
+// reads: every chunk is decoded and sent downstream while the
+// next one is on the wire. If a later chunk is malformed the whole
+// sweep is rejected: sweepDone() is then emitted empty and the
+// receiver must discard the chunks already received.
+void
+Keithley236::readSweep() {
+    qint64 timestamp = K236Parser::timestamp();
+    sweepBuffer.resize(0);
+    sweepData.resize(0);
+    sweepMaxMeasure = 0.0;
+    bSweepOverflow  = false;
+    int nReceived = 0;
+    int nDecoded  = 0;
+    bool bDecodeOk = true;
+    bool bEnd = false;
+    while(!bEnd) {
+        // The buffer must not move while the transfer is in progress
+        sweepBuffer.resize(nReceived+SWEEP_CHUNK);
+        pBus->readAsync(gpibId, sweepBuffer.data()+nReceived, SWEEP_CHUNK);
+        if(isGpibError(QString(Q_FUNC_INFO) + "ibrda() Error"))
+            break;
+        if(bDecodeOk)
+            bDecodeOk = decodeSweep(nDecoded, nReceived, timestamp, false);
+        int iStatus = pBus->wait(gpibId, CMPL | TIMO);
+        if(!(iStatus & CMPL)) {
+            pBus->stop(gpibId);
+            emit sendMessage(QString(Q_FUNC_INFO) + "Timeout reading sweep data");
+            break;
+        }
+        if(isGpibError(QString(Q_FUNC_INFO) + "Error reading sweep data"))
+            break;
+        nReceived += int(pBus->count());
+        bEnd = (iStatus & END) || (pBus->count() < SWEEP_CHUNK);
+    }
+    sweepBuffer.resize(nReceived);
+    if(bDecodeOk)
+        bDecodeOk = decodeSweep(nDecoded, nReceived, timestamp, true);
+    if(!bDecodeOk) {
+        emit sendMessage(QString(Q_FUNC_INFO) + "Malformed sweep data");
+        sweepData.resize(0);
+    }
+    if(bSweepOverflow) {
+        bRangeOverflow = true; // The next sweep will autorange
+        emit sendMessage(QString(Q_FUNC_INFO) + "Range Overflow during the sweep");
+    }
+    else if(!sweepData.isEmpty()) {
+        rememberMeasure(fixedFunction, sweepMaxMeasure);
+        // For the automatic acquisition: the noise is the mean departure
+        // of every reading from the mean of its two neighbours
+        int nReadings = sweepData.count();
+        if((nReadings > 2) && (sweepMaxMeasure > 0.0)) {
+            double dScatter = 0.0;
+            for(int i=1; i<nReadings-1; i++)
+                dScatter += qAbs(sweepData.at(i).measure -
+                                 0.5*(sweepData.at(i-1).measure+sweepData.at(i+1).measure));
+            measureNoise = dScatter / (nReadings-2) / sweepMaxMeasure;
+        }
+        lastMeasure = sweepMaxMeasure;
+        nMeasures += nReadings;
+    }
+    emit sweepDone(sweepData);
+}
+
+
+// Decode the readings received and not yet decoded and send them
+// downstream. Unless bLast the data may end with a truncated value:
+// they are decoded only up to the last separator.
+bool
+Keithley236::decodeSweep(int &nDecoded, int nReceived, qint64 timestamp, bool bLast) {
+    const char *pData = sweepBuffer.constData() + nDecoded;
+    int nBytes = nReceived - nDecoded;
+    if(!bLast) {
+        while((nBytes > 0) && (pData[nBytes-1] != ','))
+            nBytes--;
+    }
+    if(nBytes <= 0)
+        return true;
+    int nFirst = sweepData.count();
+    int nUsed;
+    int nReadings = K236Parser::appendSweep(pData, nBytes, sweepData, timestamp, &nUsed);
+    if(nReadings < 0)
+        return false;
+    nDecoded += nUsed;
+    for(int i=nFirst; i<sweepData.count(); i++) {
+        K236Reading &reading = sweepData[i];
+        if(isOverRange(reading))
+            bSweepOverflow = true;
+        sweepMaxMeasure = qMax(sweepMaxMeasure, qAbs(reading.measure));
+    }
+    if(nReadings > 0)
+        emit sweepChunk(sweepData.mid(nFirst, nReadings));
+    return true;
+}
+
+
+// Source V sweeps of the given shape from startVoltage to stopVoltage.
+// nPoints is the number of intervals of the linear sweeps and is
+// rounded to the nearest K236 points/decade for the logarithmic ones.
+// The log sweeps cannot reach 0 V: they stop LOG_SWEEP_DECADES below
+// the largest voltage and, when the interval contains 0 V, they are
+// made of two appended segments (dense near 0 V on both sides).
+// The pulsed sweeps pulse every point for delay ms, then return to
+// 0 V for pulseOff ms.
+bool
+Keithley236::initShapedVSweep(int iShape,
+                              double startVoltage,
+                              double stopVoltage,
+                              int    nPoints,
+                              double delay,
+                              double pulseOff,
+                              double currentCompliance)
+{
+    bool bPulsed = (iShape == PulsedStair) || (iShape == PulsedLogStair);
+    int  iFirst  = bPulsed ? 4 : 1; // Q1 or Q4 (Q2 or Q5 for log)
+    QStringList sSweep;
+    if((iShape == LinearStair) || (iShape == PulsedStair)) {
+        double voltageStep = qMax(qAbs(stopVoltage-startVoltage)/qMax(nPoints, 1), 1.0e-4);
+        reserveSweep(startVoltage, stopVoltage, voltageStep);
+        sSweep << linearStair(iFirst, startVoltage, stopVoltage, voltageStep,
+                              delay, pulseOff);
+        return programVSweep(sSweep, currentCompliance, "T1,0,0,0");
+    }
+    // Logarithmic sweeps
+    double vMax = qMax(qAbs(startVoltage), qAbs(stopVoltage));
+    if(vMax == 0.0) {
+        emit sendMessage(QString(Q_FUNC_INFO) + "Invalid Log Sweep Interval");
+        return false;
+    }
+    double vMin = vMax * qPow(10.0, -LOG_SWEEP_DECADES);
+    int iPoints = logPointsCode(nPoints, LOG_SWEEP_DECADES);
+    int nTotal = 0;
+    if(startVoltage*stopVoltage > 0.0) { // A single segment
+        double vFrom = qAbs(startVoltage) < vMin ? (startVoltage > 0 ? vMin : -vMin) : startVoltage;
+        double vTo   = qAbs(stopVoltage)  < vMin ? (stopVoltage  > 0 ? vMin : -vMin) : stopVoltage;
+        sSweep << logStair(iFirst+1, vFrom, vTo, iPoints, delay, pulseOff, &nTotal);
+    }
+    else { // Toward 0 V and away from it
+        if(startVoltage != 0.0)
+            sSweep << logStair(iFirst+1, startVoltage, startVoltage > 0 ? vMin : -vMin,
+                               iPoints, delay, pulseOff, &nTotal);
+        if(stopVoltage != 0.0)
+            sSweep << logStair(sSweep.isEmpty() ? iFirst+1 : iFirst+7, // Create or Append
+                               stopVoltage > 0 ? vMin : -vMin, stopVoltage,
+                               iPoints, delay, pulseOff, &nTotal);
+    }
+    reserveSweep(0.0, double(nTotal-1), 1.0);
+    return programVSweep(sSweep, currentCompliance, "T1,0,0,0");
+}
+
+
+// Custom sweeps made of linear segments: sSegments is a list of
+// "V:N" separated by ';' and every segment goes from the end of the
+// previous one (startVoltage for the first) to V in N steps.
+// The first segment creates the sweep (Q1), the others are appended
+// (Q7) starting one step after the previous end.
+bool
+Keithley236::initSegmentedVSweep(double startVoltage,
+                                 const QString &sSegments,
+                                 double delay,
+                                 double currentCompliance)
+{
+    QVector<double> stops;
+    QVector<int> intervals;
+    if(!parseSegments(sSegments, stops, intervals)) {
+        emit sendMessage(QString(Q_FUNC_INFO) + "Invalid Custom Sweep Segments");
+        return false;
+    }
+    QStringList sSweep;
+    double vFrom = startVoltage;
+    int nTotal = 1;
+    for(int i=0; i<stops.count(); i++) {
+        double voltageStep = qMax(qAbs(stops.at(i)-vFrom)/intervals.at(i), 1.0e-4);
+        if(sSweep.isEmpty())
+            sSweep << linearStair(1, vFrom, stops.at(i), voltageStep, delay);
+        else
+            sSweep << linearStair(7, stops.at(i) > vFrom ? vFrom+voltageStep : vFrom-voltageStep,
+                                  stops.at(i), voltageStep, delay);
+        nTotal += intervals.at(i);
+        vFrom = stops.at(i);
+    }
+    reserveSweep(0.0, double(nTotal-1), 1.0);
+    return programVSweep(sSweep, currentCompliance, "T1,0,0,0");
+}
+
+
+// Decode the "V:N; V:N; ..." segments of a custom sweep.
+// Returns false if the list is empty, malformed or longer than
+// the K236 sweep buffer
+bool
+Keithley236::parseSegments(const QString &sSegments, QVector<double> &stops, QVector<int> &intervals) {
+    stops.clear();
+    intervals.clear();
+    int nTotal = 1;
+    QStringList sList = sSegments.split(";", QString::SkipEmptyParts);
+    for(int i=0; i<sList.count(); i++) {
+        QStringList sFields = sList.at(i).split(":");
+        if(sFields.count() != 2)
+            return false;
+        bool bVoltageOk, bStepsOk;
+        double dStop = sFields.at(0).trimmed().toDouble(&bVoltageOk);
+        int nSteps = sFields.at(1).trimmed().toInt(&bStepsOk);
+        if(!bVoltageOk || !bStepsOk || (nSteps < 1))
+            return false;
+        stops.append(dStop);
+        intervals.append(nSteps);
+        nTotal += nSteps;
+    }
+    return !stops.isEmpty() && (nTotal <= MAX_SWEEP_POINTS);
+}
+
+
+// Q1 (Q7 append) linear stair or Q4 (Q10 append) pulsed linear stair
+QString
+Keithley236::linearStair(int iType, double dStart, double dStop, double dStep,
+                         double delay, double pulseOff)
+{
+    if((iType % 6) == 4)
+        return QString("Q%1,%2,%3,%4,0,%5,%6")
+                .arg(iType).arg(dStart).arg(dStop).arg(dStep)
+                .arg(pulseOff).arg(delay);
+    return QString("Q%1,%2,%3,%4,0,%5")
+            .arg(iType).arg(dStart).arg(dStop).arg(dStep)
+            .arg(delay);
+}
+
+
+// Q2 (Q8 append) log stair or Q5 (Q11 append) pulsed log stair.
+// The points of the segment are added to *pPoints
+QString
+Keithley236::logStair(int iType, double dStart, double dStop, int iPoints,
+                      double delay, double pulseOff, int *pPoints)
+{
+    static const int logPoints[4] = { 5, 10, 25, 50 }; // Points per decade
+    *pPoints += int(qAbs(log10(dStop/dStart))*logPoints[iPoints] + 1.0e-6) + 1;
+    if((iType % 6) == 5)
+        return QString("Q%1,%2,%3,%4,0,%5,%6")
+                .arg(iType).arg(dStart).arg(dStop).arg(iPoints)
+                .arg(pulseOff).arg(delay);
+    return QString("Q%1,%2,%3,%4,0,%5")
+            .arg(iType).arg(dStart).arg(dStop).arg(iPoints)
+            .arg(delay);
+}
+
+
+// The K236 points/decade code (0=5, 1=10, 2=25, 3=50)
+// closest to nPoints over nDecades
+int
+Keithley236::logPointsCode(int nPoints, int nDecades) {
+    double perDecade = double(nPoints) / double(nDecades);
+    if(perDecade < 7.5)  return 0;
+    if(perDecade < 17.5) return 1;
+    if(perDecade < 37.5) return 2;
+    return 3;
+}
+
+
+// Sweep of the hardware synchronized mode: after the delay of every
+// point a pulse on TRIGGER OUT makes the instrument connected to it
+// (see initTriggeredVBias()) take its reading
+bool
+Keithley236::initLinkedVSweep(double startVoltage,
+                              double stopVoltage,
+                              double voltageStep,
+                              double delay,
+                              double currentCompliance) {
+    voltageStep = qMax(voltageStep, 1.0e-4);
+    reserveSweep(startVoltage, stopVoltage, voltageStep);
+    return programVSweep(QStringList() << linearStair(1, startVoltage, stopVoltage, voltageStep, delay),
+                         currentCompliance,
+                         "T1,0,2,0"); // Trigger on GET, Continuous, Trigger Out after Delay
+}
+
+
+// A fixed level sweep of nReadings points: a reading is taken for
+// every pulse on TRIGGER IN
+bool
+Keithley236::initTriggeredVBias(double dVoltage, int nReadings, double currentCompliance) {
+    forgetSettings();
+    reserveSweep(0.0, double(nReadings-1), 1.0);
     uint iErr = 0;
     iErr |= gpibWrite(gpibId, "M0,0X");    // SRQ Disabled, SRQ on Compliance
     iErr |= gpibWrite(gpibId, "F0,1");     // Source V, Sweep mode
     iErr |= gpibWrite(gpibId, "O1");       // Remote Sense
-    iErr |= gpibWrite(gpibId, "T1,0,0,0"); // Trigger on GET, Continuous
-    sCommand = QString("L%1,0X").arg(currentCompliance);
-    iErr |= gpibWrite(gpibId, sCommand);   // Set Compliance, Autorange Measure
+    iErr |= gpibWrite(gpibId, "T3,1,0,0"); // Trigger on TRIGGER IN, ^SRC DLY MSR
+    sCommand = QString("L%1,%2X").arg(currentCompliance).arg(selectRange(0, currentCompliance));
+    iErr |= gpibWrite(gpibId, sCommand);   // Set Compliance, Measure Range
     iErr |= gpibWrite(gpibId, "G5,2,2");   // Output Source and Measure, No Prefix, All Lines Sweep Data
     iErr |= gpibWrite(gpibId, "Z0");       // Disable suppression
-    sCommand = QString("Q1,%1,%2,%3,0,%4X")
-            .arg(startVoltage)
-            .arg(stopVoltage)
-            .arg(qMax(voltageStep, 1.0e-4))
-            .arg(delay);
-    iErr |= gpibWrite(gpibId, sCommand);   // Program Sweep
+    iErr |= gpibWrite(gpibId, filterSetting());      // Reading Filter
+    iErr |= gpibWrite(gpibId, integrationSetting()); // Integration time
+    sCommand = QString("Q0,%1,0,0,%2X")
+            .arg(dVoltage)
+            .arg(nReadings);
+    iErr |= gpibWrite(gpibId, sCommand);   // Program Fixed Level Sweep
+    iErr |= gpibWrite(gpibId, "R1");       // Arm Trigger
+    iErr |= gpibWrite(gpibId, "N1X");      // Operate !
+    if(iErr & ERR) {
+        QString sError;
+        sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
+                .arg(pBus->status(), 4, 16, QChar('0'));
+        sError += ErrMsg(pBus->status(), pBus->error(), pBus->count());
+        emit sendMessage(sError);
+        return false;
+    }
+    sCommand = QString("M%1,0X").arg(COMPLIANCE + SWEEP_DONE);
+    gpibWrite(gpibId, sCommand);   // SRQ On Sweep Done
+    if(isGpibError(QString(Q_FUNC_INFO) + "Error enabling SRQ Mask"))
+        return false;
+    // The first TRIGGER IN must find the commands executed
+    if(!waitForIdle()) {
+        emit sendMessage(QString(Q_FUNC_INFO) + "Instrument not responding");
+        return false;
+    }
+    isSweeping = true;
+    return true;
+}
+
+
+// sSweep: the sweep commands (the first one creates the sweep,
+// the others append segments to it).
+// When the instrument already holds the same sweep (as in every
+// Vg step of an Ids-Vds family) the sweep is not programmed again:
+// only the changed settings (e.g. the measure range) are sent and
+// the armed instrument is ready for the next trigger.
+bool
+Keithley236::programVSweep(const QStringList &sSweep,
+                           double currentCompliance,
+                           const QString &sTrigger)
+{
+    chooseAcquisition(); // Follows the readings of the previous sweeps
+    QString sProgram = sSweep.join("X");
+    QStringList sSettings;
+    sSettings << "F0,1" << "O1" << sTrigger
+              << QString("L%1,%2").arg(currentCompliance).arg(selectRange(0, currentCompliance))
+              << "G5,2,2" << "Z0" << filterSetting() << integrationSetting()
+              << "R1" << "N1"
+              << QString("M%1,0").arg(COMPLIANCE + SWEEP_DONE + READY_FOR_TRIGGER);
+    if(isSweeping && (settings.value('Q') == sProgram)) {
+        if(sendSettings(sSettings) & ERR) {
+            QString sError;
+            sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
+                    .arg(pBus->status(), 4, 16, QChar('0'));
+            sError += ErrMsg(pBus->status(), pBus->error(), pBus->count());
+            emit sendMessage(sError);
+            return false;
+        }
+        return true;
+    }
+    forgetSettings();
+    uint iErr = 0;
+    iErr |= gpibWrite(gpibId, "M0,0X");    // SRQ Disabled, SRQ on Compliance
+    iErr |= gpibWrite(gpibId, "F0,1");     // Source V, Sweep mode
+    iErr |= gpibWrite(gpibId, "O1");       // Remote Sense
+    iErr |= gpibWrite(gpibId, sTrigger);   // Trigger configuration
+    iErr |= gpibWrite(gpibId, sSettings.at(3) + "X"); // Set Compliance, Measure Range
+    iErr |= gpibWrite(gpibId, "G5,2,2");   // Output Source and Measure, No Prefix, All Lines Sweep Data
+    iErr |= gpibWrite(gpibId, "Z0");       // Disable suppression
+    iErr |= gpibWrite(gpibId, filterSetting());      // Reading Filter
+    iErr |= gpibWrite(gpibId, integrationSetting()); // Integration time
+    for(int i=0; i<sSweep.count(); i++)
+        iErr |= gpibWrite(gpibId, sSweep.at(i) + "X"); // Program (or Append to) the Sweep
     if(iErr & ERR) {
         QString sError;
         sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
-                .arg(ThreadIbsta(), 4, 16, QChar('0'));
-        sError = ErrMsg(ThreadIbsta(), ThreadIberr(), ThreadIbcntl());
+                .arg(pBus->status(), 4, 16, QChar('0'));
+        sError = ErrMsg(pBus->status(), pBus->error(), pBus->count());
         emit sendMessage(sError);
         return false;
     }
@@ -307,15 +913,16 @@ Keithley236::initVSweep(double startVoltage,
     if(iErr & ERR) {
         QString sError;
         sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
-                .arg(ThreadIbsta(), 4, 16, QChar('0'));
-        sError = ErrMsg(ThreadIbsta(), ThreadIberr(), ThreadIbcntl());
+                .arg(pBus->status(), 4, 16, QChar('0'));
+        sError = ErrMsg(pBus->status(), pBus->error(), pBus->count());
         emit sendMessage(sError);
         return false;
     }
-    sCommand = QString("M%1,0X").arg(COMPLIANCE + SWEEP_DONE + READY_FOR_TRIGGER);
+    sCommand = sSettings.last() + "X";
     gpibWrite(gpibId, sCommand);   // SRQ On Sweep Done
     if(isGpibError(QString(Q_FUNC_INFO) + "Error enabling SRQ Mask"))
         return false;
+    rememberSettings(sSettings << sProgram);
     isSweeping = true;
     return true;
 }
@@ -323,17 +930,17 @@ Keithley236::initVSweep(double startVoltage,
 
 int
 Keithley236::stopSweep() {
+    cancelTrigger();
 #if defined(Q_OS_LINUX)
-    if(pollTimer.isActive())
-        pollTimer.stop();
-    pollTimer.disconnect();
+    bSrqEnabled = false;
 #else
     ibnotify (gpibId, 0, NULL, NULL);// disable notification
 #endif
     gpibWrite(gpibId, "M0,0X");      // SRQ Disabled, SRQ on Compliance
     gpibWrite(gpibId, "R0");         // Disarm Trigger
     gpibWrite(gpibId, "N0X");        // Place in Stand By
-    ibclr(gpibId);
+    pBus->clearDevice(gpibId);
+    forgetSettings();
     isSweeping = false;
     return NO_ERROR;
 }
@@ -345,57 +952,77 @@ Keithley236::onGpibCallback(int LocalUd, unsigned long LocalIbsta, unsigned long
     Q_UNUSED(LocalIbcntl)
 
     spollByte = 0;
-    int iStatus = ibrsp(LocalUd, &spollByte);
+    int iStatus = pBus->serialPoll(LocalUd, &spollByte);
     if(iStatus & ERR) {
         emit sendMessage(QString(Q_FUNC_INFO) + QString("GPIB error %1").arg(LocalIberr));
         emit sendMessage(QString(Q_FUNC_INFO) + QString("ibrsp() returned: %1").arg(iStatus));
         emit sendMessage(QString(Q_FUNC_INFO) + QString("Serial Poll Response Byte %1").arg(spollByte));
     }
 
-    if(spollByte & COMPLIANCE) {// Compliance
+    handleStatus(spollByte);
+}
+
+
+// Act on the events reported in the status byte
+void
+Keithley236::handleStatus(char statusByte) {
+    if(statusByte & COMPLIANCE) {// Compliance
         iComplianceEvents++;
         emit complianceEvent();
-        QThread::msleep(300);
     }
     else
         emit clearCompliance();
 
-    if(spollByte & K236_ERROR) {// Error
-        gpibWrite(LocalUd, "U1X");
-        sCommand = gpibRead(LocalUd);
+    if(statusByte & K236_ERROR) {// Error
+        forgetSettings(); // Some command may have been rejected
+        gpibWrite(gpibId, "U1X");
+        sCommand = gpibRead(gpibId);
         QString sError = QString(Q_FUNC_INFO) + QString("Error ")+ sCommand;
         emit sendMessage(sError);
     }
 
-    if(spollByte & WARNING) {// Warning
-        gpibWrite(LocalUd, "U9X");
-        sCommand = gpibRead(LocalUd);
+    if(statusByte & WARNING) {// Warning
+        gpibWrite(gpibId, "U9X");
+        sCommand = gpibRead(gpibId);
         QString sError = QString(Q_FUNC_INFO) + QString("Warning ")+ sCommand;
         emit sendMessage(sError);
     }
 
-    if(spollByte & SWEEP_DONE) {// Sweep Done
-        QDateTime currentTime = QDateTime::currentDateTime();
-        QString sString = gpibRead(LocalUd);
+    if(statusByte & SWEEP_DONE) {// Sweep Done
+        emit sweepMeasured(); // Direct connections can use the bus before the data transfer
+        readSweep();
         keithley236::rearmMask = RQS;
-        emit sweepDone(currentTime, sString);
         return;
     }
 
-    if(spollByte & TRIGGER_OUT) {// Trigger Out
+    if(statusByte & TRIGGER_OUT) {// Trigger Out
         QString sError = QString(Q_FUNC_INFO) + QString("Trigger Out ?");
         emit sendMessage(sError);
     }
 
-    if(spollByte & READY_FOR_TRIGGER) {// Ready for trigger
+    if(statusByte & READY_FOR_TRIGGER) {// Ready for trigger
         emit readyForTrigger();
+        if(bTriggerPending)
+            fireTrigger();
     }
 
-    if((spollByte & READING_DONE) && !isSweeping){// Reading Done
-        sResponse = gpibRead(LocalUd);
-        if(sResponse != QString()) {
-            QDateTime currentTime = QDateTime::currentDateTime();
-            emit newReading(currentTime, sResponse);
+    if((statusByte & READING_DONE) && !isSweeping){// Reading Done
+        K236Reading reading;
+        if(readReading(reading)) {
+            if(statusByte & COMPLIANCE)
+                reading.flags |= K236Reading::Compliance;
+            if(isOverRange(reading)) { // Measure it again autoranging
+                bRangeOverflow = true;
+                emit sendMessage(QString(Q_FUNC_INFO) + "Range Overflow: Autoranging");
+                if(updateSource(sourceFunction, sourceLevel, fixedCompliance) == NO_ERROR)
+                    triggerWhenReady();
+                else
+                    emit triggerFailed();
+                keithley236::rearmMask = RQS;
+                return;
+            }
+            rememberMeasure(sourceFunction, qAbs(reading.measure));
+            emit newReading(reading);
         }
     }
 
@@ -405,29 +1032,283 @@ Keithley236::onGpibCallback(int LocalUd, unsigned long LocalIbsta, unsigned long
 
 bool
 Keithley236::isReadyForTrigger() {
-    ibrsp(gpibId, &spollByte);
-    if(isGpibError(QString(Q_FUNC_INFO) + ": Error in ibrsp()"))
+    if(!serialPoll())
         return false;
     return ((spollByte & READY_FOR_TRIGGER) != 0);
 }
 
 
+// A serial poll clears RQS: the service request found here
+// (instead of by the SRQ dispatcher) must be handled anyway
+bool
+Keithley236::serialPoll() {
+    pBus->serialPoll(gpibId, &spollByte);
+    if(isGpibError(QString(Q_FUNC_INFO) + ": Error in ibrsp()"))
+        return false;
+    if((spollByte & 64) && bSrqEnabled) {
+        char statusByte = spollByte;
+        QTimer::singleShot(0, this, [this, statusByte]() {
+            handleStatus(statusByte);
+        });
+    }
+    return true;
+}
+
+
+// Arm and trigger: the GET is sent as soon as the instrument
+// reports Ready for Trigger. The instrument is polled every
+// triggerTimer interval and triggered() or triggerFailed()
+// are emitted when done.
+void
+Keithley236::triggerWhenReady(int iTimeout) {
+    triggerTimeoutTime = iTimeout;
+    bTriggerPending = true;
+    triggerWaitTime.start();
+    onTriggerPoll();
+}
+
+
+// As triggerWhenReady() but the GET has been sent on return:
+// what is queued after it already sees the new source level
+bool
+Keithley236::waitAndTrigger(int iTimeout) {
+    return triggerGroup(QList<Keithley236*>() << this, iTimeout);
+}
+
+
+void
+Keithley236::cancelTrigger() {
+    triggerTimer.stop();
+    bTriggerPending = false;
+}
+
+
+// Lower rates leave more bus time to the other instruments
+void
+Keithley236::setTriggerPollInterval(int iInterval) {
+    triggerTimer.setInterval(iInterval);
+}
+
+
+void
+Keithley236::onTriggerPoll() {
+    if(!bTriggerPending) {
+        triggerTimer.stop();
+        return;
+    }
+    if(isReadyForTrigger()) {
+        fireTrigger();
+        return;
+    }
+    if(triggerWaitTime.elapsed() > triggerTimeoutTime) {
+        cancelTrigger();
+        emit sendMessage(QString(Q_FUNC_INFO) + "Timeout waiting Ready for Trigger");
+        emit triggerFailed();
+        return;
+    }
+    if(!triggerTimer.isActive())
+        triggerTimer.start();
+}
+
+
+void
+Keithley236::fireTrigger() {
+    cancelTrigger();
+    if(sendTrigger())
+        emit triggered();
+    else
+        emit triggerFailed();
+}
+
+
 bool
 Keithley236::sendTrigger() {
-    ibtrg(gpibId);
+    pBus->trigger(gpibId);
     if(isGpibError(QString(Q_FUNC_INFO) + "Trigger Error"))
         return false;
     return true;
 }
 
 
+// The instruments (on the same board) are triggered together by a
+// single GET (TriggerList()) as soon as all of them are Ready for
+// Trigger. triggered() is emitted by each one, a failure only by the
+// first one (the group is stopped once).
+bool
+Keithley236::triggerGroup(const QList<Keithley236*> &instruments, int iTimeout) {
+    if(instruments.isEmpty())
+        return false;
+    QVector<Addr4882_t> addrList;
+    for(int i=0; i<instruments.count(); i++) {
+        Keithley236 *pInstrument = instruments.at(i);
+        pInstrument->cancelTrigger();
+        if(!pInstrument->waitForStatus(pInstrument->READY_FOR_TRIGGER, iTimeout)) {
+            emit pInstrument->sendMessage(QString(Q_FUNC_INFO) + "Timeout waiting Ready for Trigger");
+            emit instruments.first()->triggerFailed();
+            return false;
+        }
+        addrList.append(MakeAddr(pInstrument->gpibAddress, NO_SAD));
+    }
+    addrList.append(NOADDR);
+    Keithley236 *pFirst = instruments.first();
+    pFirst->pBus->triggerList(pFirst->gpibNumber, addrList.constData());
+    if(pFirst->isGpibError(QString(Q_FUNC_INFO) + "TriggerList() Error")) {
+        emit pFirst->triggerFailed();
+        return false;
+    }
+    for(int i=0; i<instruments.count(); i++)
+        emit instruments.at(i)->triggered();
+    return true;
+}
+
+
 void
 Keithley236::checkNotify() {
 #if defined(Q_OS_LINUX)
-    ibrsp(gpibId, &spollByte);
+    serviceRequest();
+#endif
+}
+
+
+// The serial poll clears RQS (and the SRQ line) even
+// when the events are not of interest any more
+bool
+Keithley236::serviceRequest() {
+    if(gpibId == -1)
+        return false;
+    pBus->serialPoll(gpibId, &spollByte);
     if(isGpibError(QString(Q_FUNC_INFO) + "ibrsp() Error"))
+        return false;
     if(!(spollByte & 64))
-        return; // SRQ not enabled
-    onGpibCallback(gpibId, uint(ThreadIbsta()), uint(ThreadIberr()), ThreadIbcnt());
-#endif
+        return false; // Not requesting service
+    onServiceRequest(spollByte);
+    return true;
+}
+
+
+// The status byte comes from the serial poll of the SRQ dispatcher
+void
+Keithley236::onServiceRequest(char statusByte) {
+    spollByte = statusByte;
+    if(bSrqEnabled)
+        handleStatus(statusByte);
+}
+
+
+// True when the instrument is known to be a dc source
+// (iFunction: 0 = Source V; 1 = Source I) triggered by GET
+bool
+Keithley236::isSourceConfigured(int iFunction) {
+    int srqMask =
+            COMPLIANCE +
+            K236_ERROR +
+            READY_FOR_TRIGGER +
+            READING_DONE +
+            WARNING;
+    QStringList sSettings;
+    sSettings << "O1" << "T1,1,0,0" << "G5,2,0" << "Z0"
+              << "R1" << QString("M%1,0").arg(srqMask);
+    for(int i=0; i<sSettings.count(); i++) {
+        if(settings.value(sSettings.at(i).at(0)) != sSettings.at(i))
+            return false;
+    }
+    return settings.value('F').startsWith(QString("F%1,").arg(iFunction));
+}
+
+
+// Fast path of initSourceV() and initVvsTSourceI():
+// only the changed settings are sent (usually just B...X)
+int
+Keithley236::updateSource(int iFunction, double dLevel, double dCompliance) {
+    int iScale = selectRange(iFunction, dCompliance, dLevel == 0.0);
+    setSource(iFunction, dLevel);
+    QString sCompliance = QString("L%1,%2").arg(dCompliance).arg(iScale);
+    uint iErr = 0;
+    if((settings.value('L') != sCompliance) &&
+       (settings.value('F') != QString("F%1,1").arg(iFunction)))
+    {
+        // The Compliance command does not work in dc condition
+        sCommand = QString("F%1,1X").arg(iFunction);
+        iErr |= gpibWrite(gpibId, sCommand);
+        rememberSettings(QStringList() << sCommand.left(4));
+    }
+    iErr |= sendSettings(QStringList()
+                         << filterSetting()
+                         << integrationSetting()
+                         << sCompliance
+                         << QString("F%1,0").arg(iFunction)
+                         << QString("B%1,0,0").arg(dLevel)
+                         << "N1");
+    if(iErr & ERR) {
+        QString sError;
+        sError = QString(Q_FUNC_INFO) + QString("GPIB Error in gpibWrite(): - Status= %1")
+                .arg(pBus->status(), 4, 16, QChar('0'));
+        sError += ErrMsg(pBus->status(), pBus->error(), pBus->count());
+        emit sendMessage(sError);
+        forgetSettings();
+        return -1;
+    }
+    return NO_ERROR;
+}
+
+
+// Send, in a single message, only the settings that differ
+// from the ones the instrument already has
+uint
+Keithley236::sendSettings(const QStringList &sSettings) {
+    QString sDelta;
+    for(int i=0; i<sSettings.count(); i++) {
+        if(settings.value(sSettings.at(i).at(0)) != sSettings.at(i))
+            sDelta += sSettings.at(i);
+    }
+    if(sDelta.isEmpty())
+        return 0;
+    uint iErr = gpibWrite(gpibId, sDelta + "X");
+    if(iErr & ERR)
+        forgetSettings();
+    else
+        rememberSettings(sSettings);
+    return iErr;
+}
+
+
+void
+Keithley236::rememberSettings(const QStringList &sSettings) {
+    for(int i=0; i<sSettings.count(); i++)
+        settings[sSettings.at(i).at(0)] = sSettings.at(i);
+}
+
+
+void
+Keithley236::forgetSettings() {
+    settings.clear();
+}
+
+
+// The instrument answers to U0X (Model and Revision) only when
+// the previous commands (or a Device Clear) have been executed
+bool
+Keithley236::waitForIdle() {
+    if(gpibWrite(gpibId, "U0X") & ERR)
+        return false;
+    return gpibRead(gpibId).startsWith("236");
+}
+
+
+// Serial poll the instrument, with a bounded backoff,
+// until one of the iMask status bits is set
+bool
+Keithley236::waitForStatus(int iMask, int iTimeout) {
+    QElapsedTimer timer;
+    timer.start();
+    ulong waitTime = 1; // [ms]
+    while(timer.elapsed() < iTimeout) {
+        if(!serialPoll())
+            return false;
+        if(spollByte & iMask)
+            return true;
+        QThread::msleep(waitTime);
+        waitTime = qMin(2*waitTime, ulong(MAX_POLL_INTERVAL));
+    }
+    return false;
 }
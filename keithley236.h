@@ -23,7 +23,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QObject>
 #include <QDateTime>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QStringList>
+#include <QByteArray>
 #include "gpibdevice.h"
+#include "k236reading.h"
 
 
 class Keithley236 : public GpibDevice
@@ -40,26 +45,91 @@ public:
     int      initSourceV(double dAppliedVoltage, double dCompliance);
     int      endMeasure();
     void     onGpibCallback(int ud, unsigned long ibsta, unsigned long iberr, long ibcntl);
+    bool     serviceRequest();
+    void     onServiceRequest(char statusByte);
     bool     initISweep(double startCurrent, double stopCurrent, double currentStep, double delay, double voltageCompliance);
-    bool     initVSweep(double startVoltage, double stopVoltage, double voltageStep, double delay, double currentCompliance);
+    bool     initLinkedVSweep(double startVoltage, double stopVoltage, double voltageStep, double delay, double currentCompliance);
+    bool     initTriggeredVBias(double dVoltage, int nReadings, double currentCompliance);
+    bool     initShapedVSweep(int iShape, double startVoltage, double stopVoltage, int nPoints,
+                              double delay, double pulseOff, double currentCompliance);
+    bool     initSegmentedVSweep(double startVoltage, const QString &sSegments,
+                                 double delay, double currentCompliance);
+    static bool parseSegments(const QString &sSegments, QVector<double> &stops, QVector<int> &intervals);
     int      stopSweep();
     bool     sendTrigger();
+    static bool triggerGroup(const QList<Keithley236*> &instruments, int iTimeout=3000);
     bool     isReadyForTrigger();
+    void     triggerWhenReady(int iTimeout=3000);
+    bool     waitAndTrigger(int iTimeout=3000);
+    void     cancelTrigger();
+    void     setTriggerPollInterval(int iInterval);
     int      standBy();
+    void     setAcquisition(int iPreset);
+    void     setRangePrediction(bool bEnable);
 
 signals:
     void     complianceEvent();
     void     clearCompliance();
     void     readyForTrigger();
-    void     newReading(QDateTime currentTime, QString sReading);
-    void     sweepDone(QDateTime currentTime, QString sSweepData);
+    void     triggered();
+    void     triggerFailed();
+    void     newReading(K236Reading reading);
+    void     sweepMeasured();
+    void     sweepChunk(K236Sweep readings);
+    void     sweepDone(K236Sweep sweep);
 
 public slots:
     void checkNotify();
 
+private slots:
+    void onTriggerPoll();
+
 protected:
+    bool     isSourceConfigured(int iFunction);
+    int      updateSource(int iFunction, double dLevel, double dCompliance);
+    uint     sendSettings(const QStringList &sSettings);
+    void     rememberSettings(const QStringList &sSettings);
+    void     forgetSettings();
+    bool     waitForIdle();
+    bool     programVSweep(const QStringList &sSweep, double currentCompliance, const QString &sTrigger);
+    QString  linearStair(int iType, double dStart, double dStop, double dStep,
+                         double delay, double pulseOff=0.0);
+    QString  logStair(int iType, double dStart, double dStop, int iPoints,
+                      double delay, double pulseOff, int *pPoints);
+    int      logPointsCode(int nPoints, int nDecades);
+    void     chooseAcquisition();
+    QString  filterSetting() const;
+    QString  integrationSetting() const;
+    int      selectRange(int iFunction, double dCompliance, bool bZeroSource=false);
+    double   rangeFullScale(int iFunction, int iRange) const;
+    bool     isOverRange(K236Reading &reading) const;
+    void     rememberMeasure(int iFunction, double dMaxMeasure);
+    void     setSource(int iFunction, double dLevel);
+    bool     waitForStatus(int iMask, int iTimeout);
+    void     fireTrigger();
+    bool     serialPoll();
+    void     handleStatus(char statusByte);
+    void     reserveSweep(double dStart, double dStop, double dStep);
+    void     readSweep();
+    bool     decodeSweep(int &nDecoded, int nReceived, qint64 timestamp, bool bLast);
+    bool     readReading(K236Reading &reading);
 
 public:
+    // Sweep shapes (initShapedVSweep())
+    enum SweepShape {
+        LinearStair    = 0, // Q1
+        LogStair       = 1, // Q2 (Q8)
+        PulsedStair    = 2, // Q4
+        PulsedLogStair = 3, // Q5 (Q11)
+        CustomStair    = 4  // Q1 + Q7 (initSegmentedVSweep())
+    };
+    // Reading filter and integration time (setAcquisition())
+    enum AcquisitionPreset {
+        FastAcquisition     = 0, // P0 S1:   4ms per reading
+        BalancedAcquisition = 1, // P3 S3: 160ms
+        LowNoiseAcquisition = 2, // P5 S3: 640ms
+        AutoAcquisition     = 3  // Chosen from the last readings
+    };
     const int SRQ_DISABLED;
     const int WARNING;
     const int SWEEP_DONE;
@@ -75,4 +145,36 @@ private:
     int    iComplianceEvents;
     double lastReading;
     bool   isSweeping;
+    // Last settings sent to the instrument, by command letter
+    // (empty when the instrument state is not known)
+    QMap<QChar, QString> settings;
+    // Pending triggerWhenReady()
+    QTimer        triggerTimer;
+    QElapsedTimer triggerWaitTime;
+    int           triggerTimeoutTime;
+    bool          bTriggerPending;
+    // Sweep data: reused from sweep to sweep
+    QByteArray sweepBuffer;
+    K236Sweep  sweepData;
+    QByteArray readingBuffer;
+    // Acquisition
+    int    acquisitionPreset;
+    int    filterCode;      // P0..P5: 1..32 readings
+    int    integrationCode; // S0..S3: 416us, 4ms, 16.67ms, 20ms
+    double lastMeasure;
+    double measureNoise;    // Relative scatter of the last readings (or sweep)
+    int    nMeasures;
+    // Measure range prediction
+    bool   bPredictRange;
+    bool   bRangeKnown;
+    bool   bRangeOverflow;  // Autorange until a good reading
+    int    measuredFunction;
+    double lastMaxMeasure;  // Of the last reading or sweep
+    int    fixedFunction;   // Of the last compliance command:
+    int    fixedRange;      // 0 = Autorange
+    double fixedCompliance;
+    int    sourceFunction;  // dc source: 0 = Source V; 1 = Source I
+    double sourceLevel;
+    double sweepMaxMeasure;
+    bool   bSweepOverflow;
 };
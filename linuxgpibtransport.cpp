@@ -0,0 +1,183 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "linuxgpibtransport.h"
+
+
+LinuxGpibTransport::LinuxGpibTransport() {
+}
+
+
+int
+LinuxGpibTransport::openDevice(int board, int pad, int sad, int tmo, int eot, int eos) {
+    return ibdev(board, pad, sad, tmo, eot, eos);
+}
+
+
+int
+LinuxGpibTransport::setOnline(int ud, int v) {
+    return ibonl(ud, v);
+}
+
+
+int
+LinuxGpibTransport::clearDevice(int ud) {
+    return ibclr(ud);
+}
+
+
+int
+LinuxGpibTransport::isListener(int board, int pad, int sad, short *listen) {
+    return ibln(board, pad, sad, listen);
+}
+
+
+int
+LinuxGpibTransport::write(int ud, const char *data, long count) {
+    return ibwrt(ud, data, count);
+}
+
+
+int
+LinuxGpibTransport::read(int ud, char *buffer, long count) {
+    return ibrd(ud, buffer, count);
+}
+
+
+int
+LinuxGpibTransport::serialPoll(int ud, char *result) {
+    return ibrsp(ud, result);
+}
+
+
+int
+LinuxGpibTransport::trigger(int ud) {
+    return ibtrg(ud);
+}
+
+
+// Completed by wait(ud, CMPL)
+int
+LinuxGpibTransport::readAsync(int ud, char *buffer, long count) {
+    return ibrda(ud, buffer, count);
+}
+
+
+int
+LinuxGpibTransport::stop(int ud) {
+    return ibstop(ud);
+}
+
+
+int
+LinuxGpibTransport::wait(int ud, int mask) {
+    return ibwait(ud, mask);
+}
+
+
+int
+LinuxGpibTransport::setTimeout(int ud, int tmo) {
+    return ibtmo(ud, tmo);
+}
+
+
+void
+LinuxGpibTransport::sendIFC(int board) {
+    SendIFC(board);
+}
+
+
+int
+LinuxGpibTransport::configure(int board, int option, int value) {
+    return ibconfig(board, option, value);
+}
+
+
+void
+LinuxGpibTransport::devClearList(int board, const Addr4882_t *addrList) {
+    DevClearList(board, const_cast<Addr4882_t*>(addrList));
+}
+
+
+void
+LinuxGpibTransport::devClear(int board, Addr4882_t address) {
+    DevClear(board, address);
+}
+
+
+void
+LinuxGpibTransport::findListeners(int board, const Addr4882_t *padList,
+                                  Addr4882_t *resultList, int limit) {
+    FindLstn(board, const_cast<Addr4882_t*>(padList), resultList, limit);
+}
+
+
+void
+LinuxGpibTransport::send(int board, Addr4882_t address,
+                         const void *data, long count, int eotMode) {
+    Send(board, address, data, count, eotMode);
+}
+
+
+void
+LinuxGpibTransport::receive(int board, Addr4882_t address,
+                            void *buffer, long count, int termination) {
+    Receive(board, address, buffer, count, termination);
+}
+
+
+void
+LinuxGpibTransport::findRequester(int board, const Addr4882_t *addrList, short *result) {
+    FindRQS(board, const_cast<Addr4882_t*>(addrList), result);
+}
+
+
+void
+LinuxGpibTransport::allSerialPoll(int board, const Addr4882_t *addrList, short *resultList) {
+    AllSpoll(board, const_cast<Addr4882_t*>(addrList), resultList);
+}
+
+
+void
+LinuxGpibTransport::triggerList(int board, const Addr4882_t *addrList) {
+    TriggerList(board, const_cast<Addr4882_t*>(addrList));
+}
+
+
+int
+LinuxGpibTransport::status() {
+    return ThreadIbsta();
+}
+
+
+int
+LinuxGpibTransport::error() {
+    return ThreadIberr();
+}
+
+
+long
+LinuxGpibTransport::count() {
+    return ThreadIbcntl();
+}
+
+
+bool
+LinuxGpibTransport::isEmulated() const {
+    return false;
+}
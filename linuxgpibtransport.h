@@ -0,0 +1,64 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include "gpibtransport.h"
+
+
+// The real bus: a thin wrapper around linux-gpib (or NI-488.2)
+class LinuxGpibTransport : public GpibTransport
+{
+public:
+    LinuxGpibTransport();
+
+public:
+    int  openDevice(int board, int pad, int sad, int tmo, int eot, int eos);
+    int  setOnline(int ud, int v);
+    int  clearDevice(int ud);
+    int  isListener(int board, int pad, int sad, short *listen);
+    int  write(int ud, const char *data, long count);
+    int  read(int ud, char *buffer, long count);
+    int  serialPoll(int ud, char *result);
+    int  trigger(int ud);
+    int  readAsync(int ud, char *buffer, long count);
+    int  stop(int ud);
+
+    int  wait(int ud, int mask);
+    int  setTimeout(int ud, int tmo);
+
+    void sendIFC(int board);
+    int  configure(int board, int option, int value);
+    void devClearList(int board, const Addr4882_t *addrList);
+    void devClear(int board, Addr4882_t address);
+    void findListeners(int board, const Addr4882_t *padList,
+                       Addr4882_t *resultList, int limit);
+    void send(int board, Addr4882_t address,
+              const void *data, long count, int eotMode);
+    void receive(int board, Addr4882_t address,
+                 void *buffer, long count, int termination);
+    void findRequester(int board, const Addr4882_t *addrList, short *result);
+    void allSerialPoll(int board, const Addr4882_t *addrList, short *resultList);
+    void triggerList(int board, const Addr4882_t *addrList);
+
+    int  status();
+    int  error();
+    long count();
+
+    bool isEmulated() const;
+};
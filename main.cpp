@@ -17,11 +17,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *
 */
 #include "mainwindow.h"
+#include "emulatedgpibtransport.h"
+#include "k236parser.h"
+#if !defined(GPIB_EMULATOR_ONLY)
+#include "linuxgpibtransport.h"
+#endif
+
 #include <QApplication>
 #include <QMessageBox>
 #include <QSharedMemory>
 #include <QFileInfo>
 #include <QThread>
+#include <QScopedPointer>
 #include <QDebug>
 
 
@@ -67,11 +74,30 @@ main(int argc, char *argv[]) {
 
     qDebug() << QT_VERSION;
 
+    // Cost of decoding the sweep data
+    if(a.arguments().contains("--benchmark-parser")) {
+        qInfo().noquote() << K236Parser::benchmark(1000, 1000);
+        return 0;
+    }
+
+    // The in-process Keithley 236 emulator replaces the GPIB bus
+    // when requested with --emulator (or when built without linux-gpib)
+    QScopedPointer<GpibTransport> pBus;
+#if defined(GPIB_EMULATOR_ONLY)
+    pBus.reset(new EmulatedGpibTransport());
+#else
+    if(a.arguments().contains("--emulator"))
+        pBus.reset(new EmulatedGpibTransport());
+    else
+        pBus.reset(new LinuxGpibTransport());
+#endif
+    GpibTransport::setInstance(pBus.data());
+
 #ifndef TEST_NO_INTERFACE
 #ifdef Q_OS_LINUX
     QString sGpibInterface = QString("/dev/gpib%1").arg(gpibBoardID);
     QFileInfo checkFile(sGpibInterface);
-    while(!checkFile.exists()) {
+    while(!pBus->isEmulated() && !checkFile.exists()) {
         msgBox.setWindowTitle(QCoreApplication::applicationName());
         msgBox.setIcon(QMessageBox::Critical);
         msgBox.setText(QString("No %1 device file").arg(sGpibInterface));
@@ -86,7 +112,6 @@ main(int argc, char *argv[]) {
 
     MainWindow w(gpibBoardID);
     w.setWindowIcon(QIcon("qrc:/myLogoT.png"));
-    w.thread()->setPriority(QThread::TimeCriticalPriority);
     w.show();
     QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
 
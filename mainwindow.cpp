@@ -32,7 +32,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "vgtab.h"
 #include "filetab.h"
 #include "keithley236.h"
+#include "gpibworker.h"
+#include "srqdispatcher.h"
 #include "plot2d.h"
+#include "runwriter.h"
+#include "textsink.h"
+#include "runfilesink.h"
+#include "binarysink.h"
+#include "journalsink.h"
 
 #include <qmath.h>
 #include <QMessageBox>
@@ -41,19 +48,37 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QThread>
 #include <QLayout>
 #include <QFileInfo>
+#include <QFileDialog>
 #include <QDir>
 #include <QStandardPaths>
 #include <QDebug>
+#include <QTimer>
 
 
 //#define MY_DEBUG
 
+// Time allowed to the Ids Evaluator for completing a
+// linked sweep after the Vg Generator has completed its own
+#define LINKED_SWEEP_TIMEOUT 5000 // [ms]
+
+// An Rds point is taken when two consecutive Ids readings agree
+#define SETTLING_REL_TOLERANCE 2.0e-3
+#define SETTLING_ABS_TOLERANCE 1.0e-12 // [A]
+#define SETTLING_MAX_READINGS  8
+
+// A journal step belongs to the resumed run when its Vg
+// is the one the Vg steps give again
+#define RESUME_VG_TOLERANCE 1.0e-6 // [V]
+
 
 
 MainWindow::MainWindow(int iBoard, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
-    , pOutputFile(nullptr)
+    , pBus(GpibTransport::instance())
+    , pWorker(nullptr)
+    , pSrqDispatcher(nullptr)
+    , pRunWriter(nullptr)
     , pLogFile(nullptr)
     , pIdsEvaluator(nullptr)
     , pVgGenerator(nullptr)
@@ -64,6 +89,32 @@ MainWindow::MainWindow(int iBoard, QWidget *parent)
     maxPlotPoints        = 3000;
     gpibBoardID          = iBoard;
     bMeasureInProgress   = false;
+    linkedCurve          = 0;
+    bVgRead              = false;
+    bIdsRead             = false;
+    bNextVgProgrammed    = false;
+    nextVg               = 0.0;
+    passRdsSum           = 0.0;
+    passRdsCount         = 0;
+    bStepOpen            = false;
+    idsTimestamp         = 0;
+
+    // Readings are queued from the acquisition thread
+    qRegisterMetaType<K236Reading>("K236Reading");
+    qRegisterMetaType<K236Sweep>("K236Sweep");
+
+    // The instruments live in the acquisition thread of the board
+    pWorker = new GpibWorker(gpibBoardID);
+#if defined(Q_OS_LINUX)
+    // On Linux the instrument events are notified by the SRQ dispatcher
+    pSrqDispatcher = new SrqDispatcher(gpibBoardID, pWorker);
+#endif
+    // The output is written in a thread of its own
+    pRunWriter = new RunWriter();
+    connect(pRunWriter, SIGNAL(sendMessage(QString)),
+            this, SLOT(onLogMessage(QString)));
+    connect(pRunWriter, SIGNAL(writeFailed(QString)),
+            this, SLOT(onWriteFailed(QString)));
 
     // Prepare message logging
     sLogFileName = QString("gFETLog.txt");
@@ -91,8 +142,6 @@ MainWindow::MainWindow(int iBoard, QWidget *parent)
     restoreState(settings.value("mainWindowState").toByteArray());
     restoreSettings();
 
-    thread()->setPriority(QThread::TimeCriticalPriority);
-
 //    #ifdef TEST_NO_INTERFACE
 //        for(int i=0; i<2; i++) {
 //            ui->comboIds->addItem(QString("%1").arg(i+10));
@@ -113,11 +162,12 @@ MainWindow::MainWindow(int iBoard, QWidget *parent)
 
 
 MainWindow::~MainWindow() {
-    if(pIdsEvaluator)    delete pIdsEvaluator;
-    if(pVgGenerator)     delete pVgGenerator;
+    deleteInstruments();
+    if(pSrqDispatcher)   delete pSrqDispatcher;
+    delete pWorker;
     if(pPlot)            delete pPlot;
     if(pConfigureDialog) delete pConfigureDialog;
-    if(pOutputFile)      delete pOutputFile;
+    delete pRunWriter;
     if(pLogFile)         delete pLogFile;
     delete ui;
 }
@@ -134,23 +184,16 @@ MainWindow::closeEvent(QCloseEvent *event) {
     settings.setValue("mainWindowState", saveState());
     saveSettings();
     if(bMeasureInProgress) {
-        if(pOutputFile) {
-            if(pOutputFile->isOpen())
-                pOutputFile->close();
-            pOutputFile->deleteLater();
-            pOutputFile = nullptr;
-        }
-        if(pIdsEvaluator) {
-            pIdsEvaluator->endMeasure();
-        }
-        if(pVgGenerator) {
-            pVgGenerator->endMeasure();
-        }
+        pRunWriter->closeRun();
+        pWorker->clear();
+        Keithley236 *pIds = pIdsEvaluator;
+        Keithley236 *pVg  = pVgGenerator;
+        pWorker->call([pIds, pVg]() {
+            if(pIds) pIds->endMeasure();
+            if(pVg)  pVg->endMeasure();
+        });
     }
-    if(pIdsEvaluator) delete pIdsEvaluator;
-    if(pVgGenerator)  delete pVgGenerator;
-    pIdsEvaluator = nullptr;
-    pVgGenerator  = nullptr;
+    deleteInstruments();
 
     if(pPlot) delete pPlot;
     pPlot = nullptr;
@@ -246,10 +289,7 @@ MainWindow::criticalError(QString sWhere, QString sText, QString sInfText) {
 /////////////////////////////////////////////
 bool
 MainWindow::checkInstruments() {
-    if(pIdsEvaluator != nullptr) delete pIdsEvaluator;
-    if(pVgGenerator  != nullptr) delete pVgGenerator;
-    pIdsEvaluator = nullptr;
-    pVgGenerator  = nullptr;
+    deleteInstruments();
     idsAddress = 0;
     vgAddress  = 0;
     ui->comboIds->clear();
@@ -259,8 +299,8 @@ MainWindow::checkInstruments() {
     for(uint16_t i=0; i<30; i++) padlist[i] = i+1;
     padlist[30] = NOADDR;
     // Resets the GPIB bus by asserting the 'interface clear' bus line
-    SendIFC(gpibBoardID);
-    if(ThreadIbsta() & ERR) {
+    pBus->sendIFC(gpibBoardID);
+    if(pBus->status() & ERR) {
         criticalError(QString(Q_FUNC_INFO),
                       QString("SendIFC() Error"),
                       QString("Is the GPIB Interface connected ?"));
@@ -268,8 +308,8 @@ MainWindow::checkInstruments() {
     }
     // Enable assertion of REN when System Controller
     // Required by the Keithley 236
-    ibconfig(gpibBoardID, IbcSRE, 1);
-    if(ThreadIbsta() & ERR) {
+    pBus->configure(gpibBoardID, IbcSRE, 1);
+    if(pBus->status() & ERR) {
         criticalError(QString(Q_FUNC_INFO),
                       QString("ibconfig() Error"),
                       QString("Unable to set REN When SC"));
@@ -280,22 +320,22 @@ MainWindow::checkInstruments() {
     // to all the devices on the bus
     Addr4882_t addrlist;
     addrlist = NOADDR;
-    DevClearList(gpibBoardID, &addrlist);
-    if(ThreadIbsta() & ERR) {
+    pBus->devClearList(gpibBoardID, &addrlist);
+    if(pBus->status() & ERR) {
         criticalError(QString(Q_FUNC_INFO),
                       QString("DevClearList() failed"),
                       QString("Are the Instruments Connected and Switched On ?"));
         return false;
     }
     // Find all the instruments connected to the GPIB Bus
-    FindLstn(gpibBoardID, padlist, resultlist, 30);
-    if(ThreadIbsta() & ERR) {
+    pBus->findListeners(gpibBoardID, padlist, resultlist, 30);
+    if(pBus->status() & ERR) {
         criticalError(QString(Q_FUNC_INFO),
                       QString("FindLstn() failed"),
                       QString("Are the Instruments Connected and Switched On ?"));
         return false;
     }
-    int nDevices = ThreadIbcnt();
+    int nDevices = int(pBus->count());
 #if defined(MY_DEBUG)
     logMessage(QString("Found %1 Instruments connected to the GPIB Bus").arg(nDevices));
 #endif
@@ -305,10 +345,10 @@ MainWindow::checkInstruments() {
     // Check for the Keithley 236
     sCommand = "U0X";
     for(int i=0; i<nDevices; i++) {
-        DevClear(gpibBoardID, resultlist[i]);
-        Send(gpibBoardID, resultlist[i], sCommand.toUtf8().constData(), sCommand.length(), DABend);
-        Receive(gpibBoardID, resultlist[i], readBuf, 256, STOPend);
-        readBuf[ThreadIbcnt()] = '\0';
+        pBus->devClear(gpibBoardID, resultlist[i]);
+        pBus->send(gpibBoardID, resultlist[i], sCommand.toUtf8().constData(), sCommand.length(), DABend);
+        pBus->receive(gpibBoardID, resultlist[i], readBuf, 256, STOPend);
+        readBuf[pBus->count()] = '\0';
         sInstrumentID = QString(readBuf);
 #if defined(MY_DEBUG)
         logMessage(QString("Address= %1 - InstrumentID= %2")
@@ -332,9 +372,7 @@ MainWindow::checkInstruments() {
     // use it as Ids Measuring System
     if(ui->comboIds->count() == 1) {
         idsAddress = Addr4882_t(ui->comboIds->itemText(0).toInt());
-        pIdsEvaluator = new Keithley236(gpibBoardID, idsAddress, this);
-        connect(pIdsEvaluator, SIGNAL(sendMessage(QString)),
-                this, SLOT(onLogMessage(QString)));
+        pIdsEvaluator = newInstrument(idsAddress);
         ui->statusBar->showMessage("Ids Evaluator Found! Ready to Start");
         return true;
     }
@@ -343,26 +381,18 @@ MainWindow::checkInstruments() {
     // Check if we already have choosen the Ids Evaluator
     for(int i=0; i<2; i++) {
         if(ui->comboIds->itemText(i).toInt() == idsAddress) {
-            pIdsEvaluator = new Keithley236(gpibBoardID, idsAddress, this);
-            connect(pIdsEvaluator, SIGNAL(sendMessage(QString)),
-                    this, SLOT(onLogMessage(QString)));
+            pIdsEvaluator = newInstrument(idsAddress);
             vgAddress = Addr4882_t(ui->comboIds->itemText(1-i).toInt());
-            pVgGenerator = new Keithley236(gpibBoardID, vgAddress, this);
-            connect(pVgGenerator, SIGNAL(sendMessage(QString)),
-                    this, SLOT(onLogMessage(QString)));
+            pVgGenerator = newInstrument(vgAddress);
             ui->comboIds->setCurrentIndex(i);
             ui->statusBar->showMessage("GPIB Instruments Found! Ready to Start");
             return true;
         }
     }
     idsAddress = Addr4882_t(ui->comboIds->itemText(0).toInt());
-    pIdsEvaluator = new Keithley236(gpibBoardID, idsAddress, this);
-    connect(pIdsEvaluator, SIGNAL(sendMessage(QString)),
-            this, SLOT(onLogMessage(QString)));
+    pIdsEvaluator = newInstrument(idsAddress);
     vgAddress = Addr4882_t(ui->comboIds->itemText(1).toInt());
-    pVgGenerator = new Keithley236(gpibBoardID, vgAddress, this);
-    connect(pVgGenerator, SIGNAL(sendMessage(QString)),
-            this, SLOT(onLogMessage(QString)));
+    pVgGenerator = newInstrument(vgAddress);
     ui->comboIds->setCurrentIndex(0);
     ui->statusBar->showMessage("GPIB Instruments Found! Ready to Start");
     return true;
@@ -378,66 +408,88 @@ MainWindow::updateUserInterface() {
         ui->statusGroupBox->setEnabled(true);
         ui->startIDSButton->setEnabled(true);
         ui->startRdsButton->setEnabled(true);
+        ui->resumeButton->setEnabled(true);
     }
 
     else if(presentMeasure == IdsVds_vs_Vg) {
         ui->statusGroupBox->setDisabled(true);
         ui->startIDSButton->setEnabled(true);
         ui->startRdsButton->setDisabled(true);
+        ui->resumeButton->setDisabled(true);
     }
 
     else if(presentMeasure == Rds_vs_Vg) {
         ui->statusGroupBox->setDisabled(true);
         ui->startIDSButton->setDisabled(true);
         ui->startRdsButton->setEnabled(true);
+        ui->resumeButton->setDisabled(true);
     }
 }
 
 
-/////////////////////////////////////////////
-////////////////////////////// To be modified
-/////////////////////////////////////////////
+// The output of the new run: the journal, the text files of the
+// steps (or a single one, possibly compressed) and, if requested,
+// the binary run file.
+// When resuming, the steps before resumeStep are replayed by the caller
 void
-MainWindow::writeFileHeader() {
-    // To cope with the GnuPlot way to handle the comment lines
-    pOutputFile->write(QString("%1 %2 %3 %4\n")
-                       .arg("#V_G[V]", 12)
-                       .arg("I_G[A]",  12)
-                       .arg("V_DS[V]", 12)
-                       .arg("I_DS[A]", 12)
-                       .toLocal8Bit());
-    QStringList HeaderLines = pConfigureDialog->pTabFile->sSampleInfo.split("\n");
-    for(int i=0; i<HeaderLines.count(); i++) {
-        pOutputFile->write("# ");
-        pOutputFile->write(HeaderLines.at(i).toLocal8Bit());
-        pOutputFile->write("\n");
-    }
-    pOutputFile->write(QString("# Vds_Start=%1[V] Vds_Stop=%2[V] Compliance=%3[A]\n")
-                       .arg(pConfigureDialog->pIdsTab->dStart)
-                       .arg(pConfigureDialog->pIdsTab->dStop)
-                       .arg(pConfigureDialog->pIdsTab->dCompliance).toLocal8Bit());
-    pOutputFile->write(QString("# Vg_Start=%1[V] Vg_Stop=%2[V] Compliance=%3[A]\n")
-                       .arg(pConfigureDialog->pVgTab->dStart)
-                       .arg(pConfigureDialog->pVgTab->dStop)
-                       .arg(pConfigureDialog->pVgTab->dCompliance).toLocal8Bit());
-    pOutputFile->flush();
-}
-
-
-bool
-MainWindow::DecodeReadings(QString sDataRead, double *current, double *voltage) { // Decode readings
-#if (QT_VERSION < 0x050E00)
-    QStringList sMeasures = QStringList(sDataRead.split(",", QString::SkipEmptyParts));
-#else
-    QStringList sMeasures = QStringList(sDataRead.split(",", Qt::SkipEmptyParts));
-#endif
-    if(sMeasures.count() < 2) {
-        logMessage("Measurement Format Error");
-        return false;
-    }
-    *current = sMeasures.at(1).toDouble();
-    *voltage = sMeasures.at(0).toDouble();
-    return true;
+MainWindow::openRunOutput(int resumeStep) {
+    IDSTab  *pIdsTab  = pConfigureDialog->pIdsTab;
+    VGTab   *pVgTab   = pConfigureDialog->pVgTab;
+    FileTab *pTabFile = pConfigureDialog->pTabFile;
+    RunInfo info;
+    info.sBaseDir        = pTabFile->sBaseDir;
+    info.sFileName       = pTabFile->sOutFileName;
+    info.sSampleInfo     = pTabFile->sSampleInfo;
+    info.iMeasure        = presentMeasure;
+    info.bReadingsColumn = (presentMeasure == Rds_vs_Vg) && !pVgTab->bHardwareSync;
+    info.vdsStart        = pIdsTab->dStart;
+    info.vdsStop         = pIdsTab->dStop;
+    info.idsCompliance   = pIdsTab->dCompliance;
+    info.vgStart         = pVgTab->dStart;
+    info.vgStop          = pVgTab->dStop;
+    info.vgCompliance    = pVgTab->dCompliance;
+    info.startTime       = QDateTime::currentDateTime();
+    info.resumeStep      = resumeStep;
+    info.bCompressed     = pTabFile->bCompressed;
+    info.parameters
+        << QString("Ids.Start=%1").arg(pIdsTab->dStart, 0, 'g', 15)
+        << QString("Ids.Stop=%1").arg(pIdsTab->dStop, 0, 'g', 15)
+        << QString("Ids.Compliance=%1").arg(pIdsTab->dCompliance, 0, 'g', 15)
+        << QString("Ids.WaitTime=%1").arg(pIdsTab->iWaitTime)
+        << QString("Ids.SweepPoints=%1").arg(pIdsTab->iNSweepPoints)
+        << QString("Ids.SweepShape=%1").arg(pIdsTab->iSweepShape)
+        << QString("Ids.PulseOff=%1").arg(pIdsTab->iPulseOff)
+        << QString("Ids.Segments=%1").arg(pIdsTab->sSegments)
+        << QString("Ids.Acquisition=%1").arg(pIdsTab->iAcquisition)
+        << QString("Vg.Start=%1").arg(pVgTab->dStart, 0, 'g', 15)
+        << QString("Vg.Stop=%1").arg(pVgTab->dStop, 0, 'g', 15)
+        << QString("Vg.Step=%1").arg(pVgTab->dStep, 0, 'g', 15)
+        << QString("Vg.Compliance=%1").arg(pVgTab->dCompliance, 0, 'g', 15)
+        << QString("Vg.WaitTime=%1").arg(pVgTab->iWaitTime)
+        << QString("Vg.Adaptive=%1").arg(pVgTab->bAdaptive ? 1 : 0)
+        << QString("Vg.MaxPoints=%1").arg(pVgTab->iMaxPoints)
+        << QString("Vg.HardwareSync=%1").arg(pVgTab->bHardwareSync ? 1 : 0)
+        << QString("Vg.Acquisition=%1").arg(pVgTab->iAcquisition)
+        << QString("File.FlushPoints=%1").arg(pTabFile->iFlushPoints)
+        << QString("File.FlushInterval=%1").arg(pTabFile->iFlushInterval)
+        << QString("File.SyncAtStepEnd=%1").arg(pTabFile->bSyncAtStepEnd ? 1 : 0)
+        << QString("File.BinaryOutput=%1").arg(pTabFile->bBinaryOutput ? 1 : 0)
+        << QString("File.SingleFile=%1").arg(pTabFile->bSingleFile ? 1 : 0)
+        << QString("File.Compressed=%1").arg(pTabFile->bCompressed ? 1 : 0);
+    DurabilityPolicy policy;
+    policy.flushPoints    = pTabFile->iFlushPoints;
+    policy.flushInterval  = pTabFile->iFlushInterval;
+    policy.bSyncAtStepEnd = pTabFile->bSyncAtStepEnd;
+    QList<RunSink*> sinks;
+    sinks << new JournalSink();
+    if(pTabFile->bSingleFile || info.bCompressed)
+        sinks << new RunFileSink();
+    else
+        sinks << new TextSink();
+    if(pTabFile->bBinaryOutput)
+        sinks << new BinarySink();
+    pRunWriter->openRun(info, policy, sinks);
+    bStepOpen = false;
 }
 
 
@@ -446,14 +498,43 @@ MainWindow::startVdsSweep() {
     double dStart = pConfigureDialog->pIdsTab->dStart;
     double dStop = pConfigureDialog->pIdsTab->dStop;
     int nSweepPoints = pConfigureDialog->pIdsTab->iNSweepPoints;
-    double dStep = qAbs(dStop - dStart) / double(nSweepPoints);
+    int iShape = pConfigureDialog->pIdsTab->iSweepShape;
     double dDelayms = double(pConfigureDialog->pIdsTab->iWaitTime);
+    double dPulseOff = double(pConfigureDialog->pIdsTab->iPulseOff);
+    QString sSegments = pConfigureDialog->pIdsTab->sSegments;
     double dCompliance = pConfigureDialog->pIdsTab->dCompliance;
-    connect(pIdsEvaluator, SIGNAL(sweepDone(QDateTime,QString)),
-            this, SLOT(onIdsSweepDone(QDateTime,QString)));
-    pIdsEvaluator->initVSweep(dStart, dStop, dStep, dDelayms, dCompliance);
-    while(!pIdsEvaluator->isReadyForTrigger()) {}
-    pIdsEvaluator->sendTrigger();
+    connect(pIdsEvaluator, SIGNAL(sweepChunk(K236Sweep)),
+            this, SLOT(onIdsSweepChunk(K236Sweep)));
+    connect(pIdsEvaluator, SIGNAL(sweepDone(K236Sweep)),
+            this, SLOT(onIdsSweepDone(K236Sweep)));
+    Keithley236 *pIds = pIdsEvaluator;
+    // When the next Vg is already known, it is programmed (in the
+    // acquisition thread) as soon as the instrument has completed the
+    // sweep: the gate settles while the data are transferred, saved
+    // and plotted
+    QObject::disconnect(vgPipeline);
+    bNextVgProgrammed = vgStepper.peekNext(nextVg);
+    if(bNextVgProgrammed) {
+        Keithley236 *pVg = pVgGenerator;
+        double dVg = nextVg;
+        double dVgCompliance = pConfigureDialog->pVgTab->dCompliance;
+        vgPipeline = connect(pIds, &Keithley236::sweepMeasured, pVg, [pVg, dVg, dVgCompliance]() {
+            pVg->initSourceV(dVg, dVgCompliance);
+            pVg->waitAndTrigger();
+        }, Qt::DirectConnection);
+    }
+    pWorker->post([=]() {
+        bool bProgrammed;
+        if(iShape == Keithley236::CustomStair)
+            bProgrammed = pIds->initSegmentedVSweep(dStart, sSegments, dDelayms, dCompliance);
+        else
+            bProgrammed = pIds->initShapedVSweep(iShape, dStart, dStop, nSweepPoints,
+                                                 dDelayms, dPulseOff, dCompliance);
+        if(bProgrammed)
+            pIds->triggerWhenReady();
+        else
+            QMetaObject::invokeMethod(this, "onTriggerFailed", Qt::QueuedConnection);
+    });
     bMeasureInProgress = true;
     ui->statusBar->showMessage("Sweeping...Please Wait");
 }
@@ -461,18 +542,19 @@ MainWindow::startVdsSweep() {
 
 void
 MainWindow::stopMeasure() {
-    if(pOutputFile) {
-        pOutputFile->close();
-        pOutputFile->deleteLater();
-        pOutputFile = nullptr;
-    }
+    pRunWriter->closeRun();
+    bStepOpen = false;
+    // Pending commands are dropped: stopping comes first
+    pWorker->clear();
     if(pIdsEvaluator != nullptr) {
         pIdsEvaluator->disconnect();
-        pIdsEvaluator->stopSweep();
+        Keithley236 *pIds = pIdsEvaluator;
+        pWorker->post([pIds]() { pIds->stopSweep(); }, GpibWorker::HighPriority);
     }
     if(pVgGenerator != nullptr) {
         pVgGenerator->disconnect();
-        pVgGenerator->stopSweep();
+        Keithley236 *pVg = pVgGenerator;
+        pWorker->post([pVg]() { pVg->stopSweep(); }, GpibWorker::HighPriority);
     }
     ui->startIDSButton->setText("Ids-Vds (vs Vg)");
     ui->startRdsButton->setText("Rds (vs Vg)");
@@ -482,36 +564,6 @@ MainWindow::stopMeasure() {
 }
 
 
-bool
-MainWindow::prepareOutputFile(QString sBaseDir,
-                              QString sFileName,
-                              int currentStep)
-{
-    if(pOutputFile) {
-        pOutputFile->close();
-        pOutputFile->deleteLater();
-        pOutputFile = nullptr;
-    }
-    QFileInfo fileInfo(sFileName);
-    QString sName = fileInfo.baseName();
-    QString sExt = fileInfo.completeSuffix();
-    QString sFilePath = QString("%1/%2_%3.%4")
-                                .arg(sBaseDir,
-                                sName)
-                                .arg(currentStep)
-                                .arg(sExt);
-    pOutputFile = new QFile(sFilePath);
-    if(!pOutputFile->open(QIODevice::Text|QIODevice::WriteOnly)) {
-        QMessageBox::critical(this,
-                              "Error: Unable to Open Output File",
-                              sFilePath);
-        ui->statusBar->showMessage("Unable to Open Output file...");
-        return false;
-    }
-    return true;
-}
-
-
 void
 MainWindow::initPlot(QString sTitle) {
     if(pPlot) delete pPlot;
@@ -525,47 +577,60 @@ MainWindow::initPlot(QString sTitle) {
 }
 
 
-void
-MainWindow::on_startIDSButton_clicked() {
-    if(ui->startIDSButton->text().contains("Stop")) {
-        stopMeasure();
-        ui->statusBar->showMessage("Measure Stopped");
-        return;
-    }
-    //else
-    onClearIdsComplianceEvent();
-    onClearIgComplianceEvent();
-    if(pConfigureDialog) delete pConfigureDialog;
-    pConfigureDialog = new ConfigureDialog(this);
-    if(pConfigureDialog->exec() == QDialog::Rejected)
-        return;
-
-    QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
-
-    presentMeasure = IdsVds_vs_Vg;
+// Both the instruments ready for the presentMeasure
+bool
+MainWindow::initInstruments() {
     // Initializing Ids Evaluator
     ui->statusBar->showMessage("Initializing Ids Evaluator...");
-    if(pIdsEvaluator->init()) {
+    if(initInstrument(pIdsEvaluator, pConfigureDialog->pIdsTab->iAcquisition)) {
         ui->statusBar->showMessage("Unable to Initialize Ids Evaluator...");
         stopMeasure();
-        return;
+        return false;
     }
     connect(pIdsEvaluator, SIGNAL(complianceEvent()),
             this, SLOT(onIdsComplianceEvent()));
     connect(pIdsEvaluator, SIGNAL(clearCompliance()),
             this, SLOT(onClearIdsComplianceEvent()));
+    connect(pIdsEvaluator, SIGNAL(triggerFailed()),
+            this, SLOT(onTriggerFailed()));
 
     // Initializing Vg Generator
     ui->statusBar->showMessage("Initializing Vg Generator..");
-    if(pVgGenerator->init()) {
+    if(initInstrument(pVgGenerator, pConfigureDialog->pVgTab->iAcquisition)) {
         ui->statusBar->showMessage("Unable to Initialize Keithley 236...");
         QApplication::restoreOverrideCursor();
-        return;
+        return false;
     }
     connect(pVgGenerator, SIGNAL(complianceEvent()),
             this, SLOT(onIgComplianceEvent()));
     connect(pVgGenerator, SIGNAL(clearCompliance()),
             this, SLOT(onClearIgComplianceEvent()));
+    connect(pVgGenerator, SIGNAL(triggerFailed()),
+            this, SLOT(onTriggerFailed()));
+    return true;
+}
+
+
+void
+MainWindow::on_startIDSButton_clicked() {
+    if(ui->startIDSButton->text().contains("Stop")) {
+        stopMeasure();
+        ui->statusBar->showMessage("Measure Stopped");
+        return;
+    }
+    //else
+    onClearIdsComplianceEvent();
+    onClearIgComplianceEvent();
+    if(pConfigureDialog) delete pConfigureDialog;
+    pConfigureDialog = new ConfigureDialog(this);
+    if(pConfigureDialog->exec() == QDialog::Rejected)
+        return;
+
+    QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
+
+    presentMeasure = IdsVds_vs_Vg;
+    if(!initInstruments())
+        return;
 
     // Init the Plot
     initPlot("Ids vs Vds");
@@ -574,13 +639,13 @@ MainWindow::on_startIDSButton_clicked() {
     /// Ready to Start the IdsVds_vs_Vg Measure
     /////////////////////////////////////////////
 
+    openRunOutput();
+
     // Generate the first value of Vg...
-    currentVg = pConfigureDialog->pVgTab->dStart;
-    pVgGenerator->initSourceV(currentVg, pConfigureDialog->pVgTab->dCompliance);
-    while(!pVgGenerator->isReadyForTrigger()) {}
-    connect(pVgGenerator, SIGNAL(newReading(QDateTime,QString)),
-            this, SLOT(onNewVgReading(QDateTime,QString)));
-    pVgGenerator->sendTrigger();
+    startVgSteps();
+    connect(pVgGenerator, SIGNAL(newReading(K236Reading)),
+            this, SLOT(onNewVgReading(K236Reading)));
+    sourceAndTrigger(pVgGenerator, currentVg, pConfigureDialog->pVgTab->dCompliance);
     currentStep = 1;
     // Then Start the Ids vs Vds Sweep
     startVdsSweep();
@@ -589,6 +654,135 @@ MainWindow::on_startIDSButton_clicked() {
 }
 
 
+// A run of the Ids-Vds family continued from its journal: the
+// configuration is the journaled one and the Vg steps are followed
+// again (the adaptive ones depend on the measured R) up to the first
+// step not completed. The completed steps are replayed to the output
+// files and to the plot, then the measure goes on from there.
+void
+MainWindow::on_resumeButton_clicked() {
+    QSettings settings;
+    QString sJournal = QFileDialog::getOpenFileName(this,
+                                                    "Journal of the Run to Resume",
+                                                    settings.value("FileTabBaseDir", QDir::homePath()).toString(),
+                                                    "gfet Run Journals (*.gfj)");
+    if(sJournal.isEmpty())
+        return;
+    RunJournal journal;
+    QString sError;
+    if(!JournalSink::read(sJournal, journal, sError)) {
+        ui->statusBar->showMessage(sError);
+        return;
+    }
+    if(journal.config.value("Measure").toInt() != IdsVds_vs_Vg) {
+        ui->statusBar->showMessage("Only the Ids-Vds (vs Vg) Runs can be Resumed");
+        return;
+    }
+    onClearIdsComplianceEvent();
+    onClearIgComplianceEvent();
+    if(pConfigureDialog) delete pConfigureDialog;
+    pConfigureDialog = new ConfigureDialog(this);
+    restoreRunConfiguration(journal, QFileInfo(sJournal).absolutePath());
+
+    QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
+
+    presentMeasure = IdsVds_vs_Vg;
+    if(!initInstruments())
+        return;
+
+    initPlot("Ids vs Vds");
+
+    startVgSteps();
+    currentStep = 1;
+    while(journal.steps.contains(currentStep)) {
+        const RunJournal::Step &step = journal.steps[currentStep];
+        if(!step.bComplete || (qAbs(step.stepValue-currentVg) > RESUME_VG_TOLERANCE))
+            break;
+        currentVg = step.stepValue;
+        QString sTitle = QString("%1").arg(currentVg);
+        pPlot->NewDataSet(currentStep,//Id
+                          3, //Pen Width
+                          Colors[currentStep % 7],
+                          Plot2D::iline,
+                          sTitle
+                          );
+        pPlot->SetShowDataSet(currentStep, true);
+        pPlot->SetShowTitle(currentStep, true);
+        double sumVds = 0.0;
+        double sumIds = 0.0;
+        for(int i=0; i<step.points.count(); i++) {
+            pPlot->NewPoint(currentStep, step.points.at(i).vds, step.points.at(i).ids);
+            sumVds += qAbs(step.points.at(i).vds);
+            sumIds += qAbs(step.points.at(i).ids);
+        }
+        if(sumIds > 1.0e-14)
+            vgStepper.addValue(currentVg, sumVds/sumIds);
+        currentStep++;
+        if(!vgStepper.nextVg(currentVg)) {
+            pPlot->UpdatePlot();
+            stopMeasure();
+            ui->statusBar->showMessage("Nothing to Resume: the Run was Complete");
+            return;
+        }
+    }
+    pPlot->UpdatePlot();
+
+    openRunOutput(currentStep);
+    for(int iStep=1; iStep<currentStep; iStep++) {
+        const RunJournal::Step &step = journal.steps[iStep];
+        pRunWriter->openStep(iStep, step.stepValue);
+        pRunWriter->write(iStep, step.points);
+        pRunWriter->closeStep(iStep);
+    }
+    logMessage(QString("Run Resumed at Step %1 (Vg=%2)").arg(currentStep).arg(currentVg));
+
+    connect(pVgGenerator, SIGNAL(newReading(K236Reading)),
+            this, SLOT(onNewVgReading(K236Reading)));
+    sourceAndTrigger(pVgGenerator, currentVg, pConfigureDialog->pVgTab->dCompliance);
+    startVdsSweep();
+    ui->startIDSButton->setText("Stop");
+    updateUserInterface();
+}
+
+
+// The configuration dialog filled with the journaled run
+void
+MainWindow::restoreRunConfiguration(const RunJournal &journal, QString sBaseDir) {
+    const QMap<QString, QString> &config = journal.config;
+    FileTab *pTabFile = pConfigureDialog->pTabFile;
+    pTabFile->sBaseDir     = sBaseDir;
+    pTabFile->sOutFileName = config.value("FileName");
+    pTabFile->sSampleInfo  = config.value("SampleInfo");
+    // Older journals have no output options: the present ones are kept
+    pTabFile->iFlushPoints   = config.value("File.FlushPoints", QString::number(pTabFile->iFlushPoints)).toInt();
+    pTabFile->iFlushInterval = config.value("File.FlushInterval", QString::number(pTabFile->iFlushInterval)).toInt();
+    pTabFile->bSyncAtStepEnd = config.value("File.SyncAtStepEnd", pTabFile->bSyncAtStepEnd ? "1" : "0").toInt() != 0;
+    pTabFile->bBinaryOutput  = config.value("File.BinaryOutput", pTabFile->bBinaryOutput ? "1" : "0").toInt() != 0;
+    pTabFile->bSingleFile    = config.value("File.SingleFile", pTabFile->bSingleFile ? "1" : "0").toInt() != 0;
+    pTabFile->bCompressed    = config.value("File.Compressed", pTabFile->bCompressed ? "1" : "0").toInt() != 0;
+    IDSTab *pIdsTab = pConfigureDialog->pIdsTab;
+    pIdsTab->dStart        = config.value("Ids.Start").toDouble();
+    pIdsTab->dStop         = config.value("Ids.Stop").toDouble();
+    pIdsTab->dCompliance   = config.value("Ids.Compliance").toDouble();
+    pIdsTab->iWaitTime     = config.value("Ids.WaitTime").toInt();
+    pIdsTab->iNSweepPoints = config.value("Ids.SweepPoints").toInt();
+    pIdsTab->iSweepShape   = config.value("Ids.SweepShape").toInt();
+    pIdsTab->iPulseOff     = config.value("Ids.PulseOff").toInt();
+    pIdsTab->sSegments     = config.value("Ids.Segments");
+    pIdsTab->iAcquisition  = config.value("Ids.Acquisition").toInt();
+    VGTab *pVgTab = pConfigureDialog->pVgTab;
+    pVgTab->dStart         = config.value("Vg.Start").toDouble();
+    pVgTab->dStop          = config.value("Vg.Stop").toDouble();
+    pVgTab->dStep          = config.value("Vg.Step").toDouble();
+    pVgTab->dCompliance    = config.value("Vg.Compliance").toDouble();
+    pVgTab->iWaitTime      = config.value("Vg.WaitTime").toInt();
+    pVgTab->bAdaptive      = config.value("Vg.Adaptive").toInt() != 0;
+    pVgTab->iMaxPoints     = config.value("Vg.MaxPoints").toInt();
+    pVgTab->bHardwareSync  = config.value("Vg.HardwareSync").toInt() != 0;
+    pVgTab->iAcquisition   = config.value("Vg.Acquisition").toInt();
+}
+
+
 void
 MainWindow::on_startRdsButton_clicked() {
     if(ui->startRdsButton->text().contains("Stop")) {
@@ -608,40 +802,82 @@ MainWindow::on_startRdsButton_clicked() {
 
     QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
     presentMeasure = Rds_vs_Vg;
-
-    // Initializing Ids Evaluator
-    ui->statusBar->showMessage("Initializing Ids Evaluator...");
-    if(pIdsEvaluator->init()) {
-        ui->statusBar->showMessage("Unable to Initialize Ids Evaluator...");
-        stopMeasure();
+    if(!initInstruments())
         return;
-    }
-    connect(pIdsEvaluator, SIGNAL(complianceEvent()),
-            this, SLOT(onIdsComplianceEvent()));
-    connect(pIdsEvaluator, SIGNAL(clearCompliance()),
-            this, SLOT(onClearIdsComplianceEvent()));
 
-    // Initializing Vg Generator
-    ui->statusBar->showMessage("Initializing Vg Generator..");
-    if(pVgGenerator->init()) {
-        ui->statusBar->showMessage("Unable to Initialize Keithley 236...");
-        QApplication::restoreOverrideCursor();
+    planRdsScan();
+    openRunOutput();
+
+    // Init the Plot
+    initPlot("Rds vs Vg");
+
+    ui->startRdsButton->setText("Stop");
+
+    if(!pConfigureDialog->pVgTab->bHardwareSync) {
+        connect(pVgGenerator, SIGNAL(newReading(K236Reading)),
+                this, SLOT(onNewVgGenerated(K236Reading)));
+        connect(pIdsEvaluator, SIGNAL(newReading(K236Reading)),
+                this, SLOT(onNewRdsReading(K236Reading)));
+    }
+    if(scanPlanner.order() == ScanPlanner::VdsOuter) {
+        startNextRdsCurve(); // The first one
+        updateUserInterface();
         return;
     }
-    connect(pVgGenerator, SIGNAL(complianceEvent()),
-            this, SLOT(onIgComplianceEvent()));
-    connect(pVgGenerator, SIGNAL(clearCompliance()),
-            this, SLOT(onClearIgComplianceEvent()));
+    // All the curves are measured together: one Vg at a time
+    for(int i=0; i<scanPlanner.vdsCount(); i++) {
+        currentStep = i+1;
+        currentVds  = scanPlanner.vdsAt(i);
+        openRdsCurve();
+    }
+    startVgSteps();
+    scanPlanner.startPass();
+    int iVds;
+    scanPlanner.nextVds(iVds);
+    currentStep = iVds+1;
+    currentVds  = scanPlanner.vdsAt(iVds);
+    startRdsPoint();
+    updateUserInterface();
+    ui->statusBar->showMessage(QString("Measure Started @Vg= %1...").arg(currentVg));
+}
 
-    currentVg  = pConfigureDialog->pVgTab->dStart;
-    currentVds = pConfigureDialog->pIdsTab->dStart;
-    pVgGenerator->initSourceV(currentVg, pConfigureDialog->pVgTab->dCompliance);
 
-    // Init the Plot
-    initPlot("Rds vs Vg");
+// The order of the Rds(Vg) points: the Vds values are the inner loop
+// (all the curves advance together, one Vg at a time) unless the Vg
+// Generator sweeps a whole Rds(Vg) curve at a time (linked curves)
+void
+MainWindow::planRdsScan() {
+    VGTab  *pVgTab  = pConfigureDialog->pVgTab;
+    IDSTab *pIdsTab = pConfigureDialog->pIdsTab;
+    int nVg = pVgTab->iMaxPoints;
+    if(!pVgTab->bAdaptive)
+        nVg = int(qAbs(pVgTab->dStop-pVgTab->dStart)/qMax(qAbs(pVgTab->dStep), 1.0e-4) + 1.0e-6) + 1;
+    scanPlanner.start(pIdsTab->dStart, pIdsTab->dStop, pIdsTab->dStep);
+    if(pVgTab->bHardwareSync) // The Vg Generator sweeps a whole curve
+        scanPlanner.setOrder(ScanPlanner::VdsOuter);
+    settling = QVector<SettlingDetector>(scanPlanner.vdsCount());
+    for(int i=0; i<settling.count(); i++)
+        settling[i].setTolerance(SETTLING_REL_TOLERANCE,
+                                 SETTLING_ABS_TOLERANCE,
+                                 SETTLING_MAX_READINGS);
+    rdsCurves = QVector<QMap<double, double> >(scanPlanner.vdsCount());
+    passRdsSum   = 0.0;
+    passRdsCount = 0;
+    logMessage(QString("Rds Scan: %1 Vds x %2 Vg, %3 outer")
+               .arg(scanPlanner.vdsCount())
+               .arg(nVg)
+               .arg(scanPlanner.order() == ScanPlanner::VgOuter ? "Vg" : "Vds"));
+}
 
-    currentStep = 1;
 
+// The output step and the Plot Data Set of the Rds(Vg) curve
+// at currentVds (identified by currentStep)
+void
+MainWindow::openRdsCurve() {
+    pRunWriter->openStep(currentStep, currentVds);
+    bStepOpen = true;
+
+    // Create New Plot Data Set
     QString sTitle = QString("%1").arg(currentVds);
     pPlot->NewDataSet(currentStep,//Id
                       3, //Pen Width
@@ -652,30 +888,28 @@ MainWindow::on_startRdsButton_clicked() {
     pPlot->SetShowDataSet(currentStep, true);
     pPlot->SetShowTitle(currentStep, true);
     pPlot->UpdatePlot();
+}
 
-    ui->statusBar->showMessage("Opening Output file...");
-    if(!prepareOutputFile(pConfigureDialog->pTabFile->sBaseDir,
-                          pConfigureDialog->pTabFile->sOutFileName,
-                          currentStep))
-    {
-        stopMeasure();
-        return;
-    }
-    // Write the new File Header
-    writeFileHeader();
 
-    connect(pVgGenerator, SIGNAL(newReading(QDateTime,QString)),
-            this, SLOT(onNewVgGenerated(QDateTime,QString)));
-    connect(pIdsEvaluator, SIGNAL(newReading(QDateTime,QString)),
-            this, SLOT(onNewRdsReading(QDateTime,QString)));
+// The Vg values of the curve: fixed or adaptive steps
+// (from dStop to dStart when reversed)
+void
+MainWindow::startVgSteps(bool bReversed) {
+    VGTab *pVgTab = pConfigureDialog->pVgTab;
+    if(bReversed)
+        vgStepper.start(pVgTab->dStop, pVgTab->dStart, pVgTab->dStep,
+                        pVgTab->bAdaptive, pVgTab->iMaxPoints);
+    else
+        vgStepper.start(pVgTab->dStart, pVgTab->dStop, pVgTab->dStep,
+                        pVgTab->bAdaptive, pVgTab->iMaxPoints);
+    vgStepper.nextVg(currentVg);
+}
 
-    ui->startRdsButton->setText("Stop");
 
-    nMeasure = 0;
-    while(!pVgGenerator->isReadyForTrigger()) {}
-    pVgGenerator->sendTrigger();
-    updateUserInterface();
-    ui->statusBar->showMessage(QString("Measure Started @Vds= %1...").arg(currentVds));
+void
+MainWindow::onTriggerFailed() {
+    stopMeasure();
+    ui->statusBar->showMessage("Instrument not Ready for Trigger: Measure Stopped");
 }
 
 
@@ -706,10 +940,11 @@ MainWindow::onClearIgComplianceEvent() {
 
 
 void
-MainWindow::onNewVgReading(QDateTime dataTime, QString sData) {
-    Q_UNUSED(dataTime)
-    if(!DecodeReadings(sData, &Ig, &Vg))
+MainWindow::onNewVgReading(K236Reading reading) {
+    if(presentMeasure == NoMeasure) // Queued before the measure was stopped
         return;
+    Ig = reading.measure;
+    Vg = reading.source;
     ui->igEdit->setText(QString("%1").arg(Ig, 10, 'g', 4, ' '));
     ui->vgEdit->setText(QString("%1").arg(Vg, 10, 'g', 4, ' '));
     QString sTitle = QString("%1").arg(currentVg);
@@ -725,54 +960,82 @@ MainWindow::onNewVgReading(QDateTime dataTime, QString sData) {
 }
 
 
+// The sweep data arrive in chunks while the transfer is in progress:
+// they are saved and plotted at once
 void
-MainWindow::onIdsSweepDone(QDateTime dataTime, QString sData) {
-    Q_UNUSED(dataTime)
-    disconnect(pIdsEvaluator, SIGNAL(sweepDone(QDateTime,QString)), this, nullptr);
-    ui->statusBar->showMessage("Sweep Done: Decoding readings...Please wait");
-#if (QT_VERSION < 0x050E00)
-    QStringList sMeasures = QStringList(sData.split(",", QString::SkipEmptyParts));
-#else
-    QStringList sMeasures = QStringList(sData.split(",", Qt::SkipEmptyParts));
-#endif
-    if(sMeasures.count() < 2) {
+MainWindow::onIdsSweepChunk(K236Sweep readings) {
+    if(presentMeasure == NoMeasure) // Queued before the measure was stopped
+        return;
+    if(!bStepOpen) { // First chunk of the sweep
+        pRunWriter->openStep(currentStep, currentVg);
+        bStepOpen = true;
+        ui->statusBar->showMessage("Reading Sweep Data...Please wait");
+    }
+    QVector<RunPoint> points(readings.count());
+    for(int i=0; i<readings.count(); i++) {
+        RunPoint &point = points[i];
+        point.vg        = Vg;
+        point.ig        = Ig;
+        point.vds       = readings.at(i).source;
+        point.ids       = readings.at(i).measure;
+        point.timestamp = readings.at(i).timestamp;
+        point.nReadings = 0;
+        pPlot->NewPoint(currentStep, point.vds, point.ids);
+    }
+    pRunWriter->write(currentStep, points);
+    pPlot->UpdatePlot();
+}
+
+
+void
+MainWindow::onIdsSweepDone(K236Sweep sweep) {
+    if(presentMeasure == NoMeasure) // Queued before the measure was stopped
+        return;
+    disconnect(pIdsEvaluator, SIGNAL(sweepChunk(K236Sweep)), this, nullptr);
+    disconnect(pIdsEvaluator, SIGNAL(sweepDone(K236Sweep)), this, nullptr);
+    QObject::disconnect(vgPipeline);
+    if(sweep.isEmpty() || !bStepOpen) {
+        // A malformed sweep arrives empty: the chunks already saved
+        // and plotted are discarded (reopening the step drops its data)
+        if(bStepOpen) {
+            pRunWriter->openStep(currentStep, currentVg);
+            pPlot->ClearDataSet(currentStep);
+            pPlot->UpdatePlot();
+        }
         stopMeasure();
         ui->statusBar->showMessage(QString(Q_FUNC_INFO) + QString(" Error: No Sweep Values"));
         onClearIdsComplianceEvent();
         onClearIgComplianceEvent();
         return;
     }
-    // Open the Output file
-    ui->statusBar->showMessage("Opening Output file...");
-    if(!prepareOutputFile(pConfigureDialog->pTabFile->sBaseDir,
-                          pConfigureDialog->pTabFile->sOutFileName,
-                          currentStep))
-    {
-        stopMeasure();
-        return;
+    // A predicted measure range too small: the Ids Evaluator
+    // autoranges now and the sweep is repeated, replacing the
+    // data of the step (still open)
+    for(int i=0; i<sweep.count(); i++) {
+        if(sweep.at(i).flags & K236Reading::Overflow) {
+            logMessage(QString("Range Overflow @Vg=%1: Sweep Repeated").arg(currentVg));
+            pRunWriter->openStep(currentStep, currentVg);
+            pPlot->ClearDataSet(currentStep);
+            if(bNextVgProgrammed) // Back to the present Vg
+                sourceAndTrigger(pVgGenerator, currentVg, pConfigureDialog->pVgTab->dCompliance);
+            startVdsSweep();
+            return;
+        }
     }
-    // Write File Header
-    writeFileHeader();
-    ui->statusBar->showMessage("Sweep Done: Updating Plot...Please wait");
-    double Ids, Vds;
-    for(int i=0; i<sMeasures.count(); i+=2) {
-        Vds = sMeasures.at(i).toDouble();
-        Ids = sMeasures.at(i+1).toDouble();
-        QString sData = QString("%1 %2 %3 %4\n")
-                .arg(Vg,  12, 'g', 6, ' ')
-                .arg(Ig,  12, 'g', 6, ' ')
-                .arg(Vds, 12, 'g', 6, ' ')
-                .arg(Ids, 12, 'g', 6, ' ');
-        pOutputFile->write(sData.toLocal8Bit());
-        pPlot->NewPoint(currentStep, Vds, Ids);
+    // All the readings have already been saved and plotted
+    pRunWriter->closeStep(currentStep);
+    bStepOpen = false;
+    // The channel resistance at this Vg drives the adaptive steps
+    double sumVds = 0.0;
+    double sumIds = 0.0;
+    for(int i=0; i<sweep.count(); i++) {
+        sumVds += qAbs(sweep.at(i).source);
+        sumIds += qAbs(sweep.at(i).measure);
     }
-    pPlot->UpdatePlot();
-    pOutputFile->flush();
-    pOutputFile->close();
+    if(sumIds > 1.0e-14)
+        vgStepper.addValue(currentVg, sumVds/sumIds);
     // Do we have anoter Vg step to execute ?
-    currentVg += pConfigureDialog->pVgTab->dStep;
-    if((currentVg > qMax(pConfigureDialog->pVgTab->dStop, pConfigureDialog->pVgTab->dStart)) ||
-       (currentVg < qMin(pConfigureDialog->pVgTab->dStop, pConfigureDialog->pVgTab->dStart)) )
+    if(!vgStepper.nextVg(currentVg))
     { // No ! all Vg steps have been executed
         stopMeasure();
         ui->statusBar->showMessage("Measure Done");
@@ -781,11 +1044,13 @@ MainWindow::onIdsSweepDone(QDateTime dataTime, QString sData) {
         return;
     }
     // else we have anoter Vg step to execute
-    pVgGenerator->initSourceV(currentVg, pConfigureDialog->pVgTab->dCompliance);
-    while(!pVgGenerator->isReadyForTrigger()) {}
-    pVgGenerator->sendTrigger();
+    if(!bNextVgProgrammed || (currentVg != nextVg))
+        sourceAndTrigger(pVgGenerator, currentVg, pConfigureDialog->pVgTab->dCompliance);
     QString sTitle = QString("%1").arg(currentVg);
     currentStep++;
+    // The next output step is ready before the first data arrive
+    pRunWriter->openStep(currentStep, currentVg);
+    bStepOpen = true;
     pPlot->NewDataSet(currentStep,//Id
                       3, //Pen Width
                       Colors[currentStep % 7],
@@ -800,130 +1065,360 @@ MainWindow::onIdsSweepDone(QDateTime dataTime, QString sData) {
 }
 
 
+Keithley236*
+MainWindow::newInstrument(Addr4882_t address) {
+    Keithley236 *pInstrument = new Keithley236(gpibBoardID, address);
+    connect(pInstrument, SIGNAL(sendMessage(QString)),
+            this, SLOT(onLogMessage(QString)));
+    pWorker->adopt(pInstrument);
+    if(pSrqDispatcher) {
+        pSrqDispatcher->addDevice(pInstrument);
+        // Started once the bus has been checked
+        if(!pSrqDispatcher->isRunning())
+            pSrqDispatcher->start(QThread::TimeCriticalPriority);
+    }
+    return pInstrument;
+}
+
+
+// The instruments must be deleted in their own thread
+void
+MainWindow::deleteInstruments() {
+    Keithley236 *pIds = pIdsEvaluator;
+    Keithley236 *pVg  = pVgGenerator;
+    pIdsEvaluator = nullptr;
+    pVgGenerator  = nullptr;
+    if(pSrqDispatcher) {
+        pSrqDispatcher->removeDevice(pIds);
+        pSrqDispatcher->removeDevice(pVg);
+    }
+    pWorker->call([pIds, pVg]() {
+        delete pIds;
+        delete pVg;
+    });
+}
+
+
+int
+MainWindow::initInstrument(Keithley236 *pInstrument, int iAcquisition) {
+    int iResult;
+    pWorker->call([pInstrument, iAcquisition, &iResult]() {
+        iResult = pInstrument->init();
+        pInstrument->setAcquisition(iAcquisition);
+    });
+    return iResult;
+}
+
+
+// Program the dc source and trigger it within the same worker job:
+// the jobs posted after it (e.g. the Ids sweep) find the source applied
+void
+MainWindow::sourceAndTrigger(Keithley236 *pInstrument, double dLevel, double dCompliance) {
+    pWorker->post([pInstrument, dLevel, dCompliance]() {
+        pInstrument->initSourceV(dLevel, dCompliance);
+        pInstrument->waitAndTrigger();
+    });
+}
+
+
+// Program both the sources and start the Vg step and the Ids
+// reading together with a single Group Execute Trigger
+void
+MainWindow::sourceAndTriggerGroup(double dVg, double dVds) {
+    Keithley236 *pVg  = pVgGenerator;
+    Keithley236 *pIds = pIdsEvaluator;
+    double vgCompliance  = pConfigureDialog->pVgTab->dCompliance;
+    double idsCompliance = pConfigureDialog->pIdsTab->dCompliance;
+    bVgRead  = false;
+    bIdsRead = false;
+    pWorker->post([=]() {
+        pVg->initSourceV(dVg, vgCompliance);
+        pIds->initSourceV(dVds, idsCompliance);
+        Keithley236::triggerGroup(QList<Keithley236*>() << pVg << pIds);
+    });
+}
+
+
 void
 MainWindow::onLogMessage(QString sMessage) {
     logMessage(sMessage);
 }
 
 
+// The output cannot be written: the measure would be lost
+void
+MainWindow::onWriteFailed(QString sError) {
+    logMessage(sError);
+    if(presentMeasure == NoMeasure)
+        return;
+    stopMeasure();
+    QMessageBox::critical(this,
+                          "Error: Unable to Write the Output",
+                          sError);
+    ui->statusBar->showMessage("Unable to Write the Output...");
+}
+
+
 void
 MainWindow::on_comboIds_currentIndexChanged(int indx) {
-    if(pIdsEvaluator != nullptr) delete pIdsEvaluator;
-    if(pVgGenerator  != nullptr) delete pVgGenerator;
-    pIdsEvaluator = pVgGenerator  = nullptr;
+    deleteInstruments();
     idsAddress = vgAddress  = 0;
 
     int iAddr = ui->comboIds->itemText(indx).toInt();
 
     idsAddress = Addr4882_t(iAddr);
-    pIdsEvaluator = new Keithley236(gpibBoardID, idsAddress, this);
-    connect(pIdsEvaluator, SIGNAL(sendMessage(QString)),
-            this, SLOT(onLogMessage(QString)));
+    pIdsEvaluator = newInstrument(idsAddress);
     if(ui->comboIds->count() > 1) {
         vgAddress = Addr4882_t(ui->comboIds->itemText(1-indx).toInt());
-        pVgGenerator = new Keithley236(gpibBoardID, vgAddress, this);
-        connect(pVgGenerator, SIGNAL(sendMessage(QString)),
-                this, SLOT(onLogMessage(QString)));
+        pVgGenerator = newInstrument(vgAddress);
     }
 }
 
 
 void
-MainWindow::onNewVgGenerated(QDateTime dataTime, QString sDataRead) {
-    Q_UNUSED(dataTime)
-    if(!DecodeReadings(sDataRead, &Ig, &Vg))
+MainWindow::onNewVgGenerated(K236Reading reading) {
+    if(presentMeasure == NoMeasure) // Queued before the measure was stopped
         return;
+    Ig = reading.measure;
+    Vg = reading.source;
     ui->igEdit->setText(QString("%1").arg(Ig, 10, 'g', 4, ' '));
     ui->vgEdit->setText(QString("%1").arg(Vg, 10, 'g', 4, ' '));
-    pIdsEvaluator->initSourceV(currentVds, pConfigureDialog->pIdsTab->dCompliance);
-    while(!pIdsEvaluator->isReadyForTrigger()) {}
-    pIdsEvaluator->sendTrigger();
+    bVgRead = true;
+    if(bIdsRead)
+        onRdsPointDone();
 }
 
 
 void
-MainWindow::onNewRdsReading(QDateTime dataTime, QString sDataRead) {
-    Q_UNUSED(dataTime)
-    pIdsEvaluator->standBy();
-    if(!DecodeReadings(sDataRead, &Ids, &Vds))
+MainWindow::onNewRdsReading(K236Reading reading) {
+    if(presentMeasure == NoMeasure) // Queued before the measure was stopped
         return;
+    Keithley236 *pIds = pIdsEvaluator;
+    pWorker->post([pIds]() { pIds->standBy(); });
+    Ids = reading.measure;
+    Vds = reading.source;
+    idsTimestamp = reading.timestamp;
     ui->idsEdit->setText(QString("%1").arg(Ids, 10, 'g', 4, ' '));
     ui->vdsEdit->setText(QString("%1").arg(Vds, 10, 'g', 4, ' '));
-    nMeasure = 1 - nMeasure;
-    if(nMeasure > 0) { // We consider only evry other measurement
-        while(!pVgGenerator->isReadyForTrigger()) {}
-        pVgGenerator->sendTrigger();
+    bIdsRead = true;
+    if(bVgRead)
+        onRdsPointDone();
+}
+
+
+// Both the Vg and the Ids readings of the point have been received
+void
+MainWindow::onRdsPointDone() {
+    bVgRead  = false;
+    bIdsRead = false;
+    if(!settling[currentStep-1].addReading(Ids)) { // Still settling: read again
+        sourceAndTriggerGroup(currentVg, currentVds);
         return;
     }
     // Salvo il dato su file
-    QString sData = QString("%1 %2 %3 %4\n")
-            .arg(Vg,  12, 'g', 6, ' ')
-            .arg(Ig,  12, 'g', 6, ' ')
-            .arg(Vds, 12, 'g', 6, ' ')
-            .arg(Ids, 12, 'g', 6, ' ');
-    pOutputFile->write(sData.toLocal8Bit());
-    pOutputFile->flush();
+    RunPoint point;
+    point.vg        = Vg;
+    point.ig        = Ig;
+    point.vds       = Vds;
+    point.ids       = Ids;
+    point.timestamp = idsTimestamp;
+    point.nReadings = settling[currentStep-1].readings();
+    pRunWriter->write(currentStep, point);
 
     // Plotto il dato
     if(fabs(Ids) > 1.0e-14) {
-        pPlot->NewPoint(currentStep, Vg, Vds/Ids);
+        QMap<double, double> &curve = rdsCurves[currentStep-1];
+        curve.insert(currentVg, Vds/Ids);
+        if(scanPlanner.order() == ScanPlanner::VgOuter) {
+            passRdsSum += Vds/Ids;
+            passRdsCount++;
+        }
+        else
+            vgStepper.addValue(currentVg, Vds/Ids);
+        if(vgStepper.isAdaptive()) { // The new point may be anywhere in the curve
+            pPlot->ClearDataSet(currentStep);
+            for(QMap<double, double>::const_iterator it=curve.constBegin(); it!=curve.constEnd(); ++it)
+                pPlot->NewPoint(currentStep, it.key(), it.value());
+        }
+        else
+            pPlot->NewPoint(currentStep, Vg, Vds/Ids);
         pPlot->UpdatePlot();
     }
-    // New Vg Step (if still inside the requested interval)
-    currentVg += pConfigureDialog->pVgTab->dStep;
-
-    if((currentVg <= qMax(pConfigureDialog->pVgTab->dStop, pConfigureDialog->pVgTab->dStart)) &&
-       (currentVg >= qMin(pConfigureDialog->pVgTab->dStop, pConfigureDialog->pVgTab->dStart)) )
-    { // Vg inside the requested interval
-        pVgGenerator->initSourceV(currentVg, pConfigureDialog->pVgTab->dCompliance);
-        while(!pVgGenerator->isReadyForTrigger()) {}
-        pVgGenerator->sendTrigger();
-    }
-    else { // Vg outside the requested interval
-        pOutputFile->close();
-        // New Vds Step (if still inside the requested interval)
-        currentVds += pConfigureDialog->pIdsTab->dStep;
-
-        if((currentVds <= qMax(pConfigureDialog->pIdsTab->dStop, pConfigureDialog->pIdsTab->dStart)) &&
-           (currentVds >= qMin(pConfigureDialog->pIdsTab->dStop, pConfigureDialog->pIdsTab->dStart)) )
-        { // Vds inside the requested interval
-            currentStep++;
-            // Open the new Output file
-            ui->statusBar->showMessage("Opening Output file...");
-            if(!prepareOutputFile(pConfigureDialog->pTabFile->sBaseDir,
-                                  pConfigureDialog->pTabFile->sOutFileName,
-                                  currentStep))
-            {
-                stopMeasure();
-                return;
-            }
-            // Write the new File Header
-            writeFileHeader();
-
-            // Create New Plot Data Set
-            QString sTitle = QString("%1").arg(currentVds);
-            pPlot->NewDataSet(currentStep,//Id
-                              3, //Pen Width
-                              Colors[currentStep % 7],
-                              Plot2D::iline,
-                              sTitle
-                              );
-            pPlot->SetShowDataSet(currentStep, true);
-            pPlot->SetShowTitle(currentStep, true);
-            pPlot->UpdatePlot();
+    nextRdsPoint();
+}
 
-            currentVg = pConfigureDialog->pVgTab->dStart;
-            pVgGenerator->initSourceV(currentVg, pConfigureDialog->pVgTab->dCompliance);
 
-            while(!pVgGenerator->isReadyForTrigger()) {}
-            pVgGenerator->sendTrigger();
-            ui->statusBar->showMessage(QString("Measure Started @Vds= %1...").arg(currentVds));
-        }  // Vds inside the requested interval
+// Source and trigger the present point of the scan
+void
+MainWindow::startRdsPoint() {
+    settling[currentStep-1].startPoint(currentVg);
+    sourceAndTriggerGroup(currentVg, currentVds);
+}
 
-        else { // Vds esterno all'intervallo richiesto
+
+void
+MainWindow::nextRdsPoint() {
+    if(scanPlanner.order() == ScanPlanner::VdsOuter) {
+        // New Vg Step (if any)
+        if(vgStepper.nextVg(currentVg))
+            startRdsPoint();
+        else // The Rds(Vg) curve is complete
+            startNextRdsCurve();
+        return;
+    }
+    // Next Vds at the present Vg (if any)
+    int iVds;
+    if(!scanPlanner.nextVds(iVds)) {
+        // All the Vds have been measured: the mean Rds
+        // at this Vg drives the adaptive steps
+        if(passRdsCount > 0)
+            vgStepper.addValue(currentVg, passRdsSum/passRdsCount);
+        passRdsSum   = 0.0;
+        passRdsCount = 0;
+        if(!vgStepper.nextVg(currentVg)) { // All the curves are complete
             ui->statusBar->showMessage("Measure Done");
-            stopMeasure(); // Close Output File and update UI
+            stopMeasure(); // Close Output Files and update UI
+            return;
         }
-    } // Vg outside the requested interval
+        scanPlanner.startPass();
+        scanPlanner.nextVds(iVds);
+        ui->statusBar->showMessage(QString("Measuring @Vg= %1...").arg(currentVg));
+    }
+    currentStep = iVds+1;
+    currentVds  = scanPlanner.vdsAt(iVds);
+    startRdsPoint();
+}
+
+
+// An Rds(Vg) curve is complete: start the next Vds step (if any).
+// The Vg steps of consecutive curves go in opposite directions.
+void
+MainWindow::startNextRdsCurve() {
+    if(bStepOpen)
+        pRunWriter->closeStep(currentStep);
+    int iVds;
+    if(scanPlanner.nextVds(iVds)) {
+        currentVds  = scanPlanner.vdsAt(iVds);
+        currentStep = iVds+1;
+        openRdsCurve();
+        scanPlanner.startPass();
+        startVgSteps(scanPlanner.isReversedPass());
+        if(pConfigureDialog->pVgTab->bHardwareSync)
+            startLinkedRdsCurve();
+        else
+            startRdsPoint();
+        ui->statusBar->showMessage(QString("Measure Started @Vds= %1...").arg(currentVds));
+    }
+    else { // Vds esterno all'intervallo richiesto
+        ui->statusBar->showMessage("Measure Done");
+        stopMeasure(); // Close Output File and update UI
+    }
+}
+
+
+// Hardware synchronized Rds(Vg) curve: the Vg Generator executes
+// the whole Vg staircase and, after the delay of each step, its
+// TRIGGER OUT makes the Ids Evaluator (TRIGGER IN) take a reading.
+// Both the sweep buffers are read at the end and merged.
+void
+MainWindow::startLinkedRdsCurve() {
+    double dStart      = pConfigureDialog->pVgTab->dStart;
+    double dStop       = pConfigureDialog->pVgTab->dStop;
+    if(scanPlanner.isReversedPass())
+        qSwap(dStart, dStop);
+    double dStep       = qMax(qAbs(pConfigureDialog->pVgTab->dStep), 1.0e-4);
+    double dDelay      = pConfigureDialog->pVgTab->iWaitTime;
+    double vgCompliance  = pConfigureDialog->pVgTab->dCompliance;
+    double idsCompliance = pConfigureDialog->pIdsTab->dCompliance;
+    double dVds        = currentVds;
+    int    nPoints     = int(qAbs(dStop-dStart)/dStep + 1.0e-6) + 1;
+
+    linkedVgSweep.clear();
+    linkedIdsSweep.clear();
+    linkedCurve++;
+    connect(pVgGenerator, SIGNAL(sweepDone(K236Sweep)),
+            this, SLOT(onLinkedVgSweepDone(K236Sweep)), Qt::UniqueConnection);
+    connect(pIdsEvaluator, SIGNAL(sweepDone(K236Sweep)),
+            this, SLOT(onLinkedIdsSweepDone(K236Sweep)), Qt::UniqueConnection);
+
+    Keithley236 *pIds = pIdsEvaluator;
+    Keithley236 *pVg  = pVgGenerator;
+    // The Ids Evaluator must be waiting for the triggers
+    // before the Vg Generator starts sweeping
+    pWorker->post([=]() {
+        if(pIds->initTriggeredVBias(dVds, nPoints, idsCompliance) &&
+           pVg->initLinkedVSweep(dStart, dStop, dStep, dDelay, vgCompliance))
+            pVg->triggerWhenReady();
+        else
+            QMetaObject::invokeMethod(this, "onTriggerFailed", Qt::QueuedConnection);
+    });
+}
+
+
+void
+MainWindow::onLinkedVgSweepDone(K236Sweep sweep) {
+    if(presentMeasure == NoMeasure) // Queued before the measure was stopped
+        return;
+    linkedVgSweep = sweep;
+    if(!linkedIdsSweep.isEmpty()) {
+        mergeLinkedSweeps();
+        return;
+    }
+    // The Ids Evaluator completes its sweep with the last trigger:
+    // if it does not, some trigger has been missed
+    int iCurve = linkedCurve;
+    QTimer::singleShot(LINKED_SWEEP_TIMEOUT, this, [this, iCurve]() {
+        if((presentMeasure == NoMeasure) || (iCurve != linkedCurve) || linkedVgSweep.isEmpty())
+            return;
+        logMessage("Ids Evaluator missed some Trigger: check the Trigger Link cable");
+        stopMeasure();
+        ui->statusBar->showMessage("Ids Evaluator not Triggered: Measure Stopped");
+    });
+}
+
+
+void
+MainWindow::onLinkedIdsSweepDone(K236Sweep sweep) {
+    if(presentMeasure == NoMeasure) // Queued before the measure was stopped
+        return;
+    linkedIdsSweep = sweep;
+    if(!linkedVgSweep.isEmpty())
+        mergeLinkedSweeps();
+}
+
+
+// The i-th Ids reading has been triggered by the i-th Vg step
+void
+MainWindow::mergeLinkedSweeps() {
+    int nPoints = qMin(linkedVgSweep.count(), linkedIdsSweep.count());
+    if(linkedVgSweep.count() != linkedIdsSweep.count())
+        logMessage(QString("Linked sweeps mismatch: %1 Vg steps, %2 Ids readings")
+                   .arg(linkedVgSweep.count())
+                   .arg(linkedIdsSweep.count()));
+    QVector<RunPoint> points(nPoints);
+    for(int i=0; i<nPoints; i++) {
+        Vg  = linkedVgSweep.at(i).source;
+        Ig  = linkedVgSweep.at(i).measure;
+        Vds = linkedIdsSweep.at(i).source;
+        Ids = linkedIdsSweep.at(i).measure;
+        RunPoint &point = points[i];
+        point.vg        = Vg;
+        point.ig        = Ig;
+        point.vds       = Vds;
+        point.ids       = Ids;
+        point.timestamp = linkedIdsSweep.at(i).timestamp;
+        point.nReadings = 0;
+        if(fabs(Ids) > 1.0e-14)
+            pPlot->NewPoint(currentStep, Vg, Vds/Ids);
+    }
+    pRunWriter->write(currentStep, points);
+    pPlot->UpdatePlot();
+    ui->igEdit->setText(QString("%1").arg(Ig, 10, 'g', 4, ' '));
+    ui->vgEdit->setText(QString("%1").arg(Vg, 10, 'g', 4, ' '));
+    ui->idsEdit->setText(QString("%1").arg(Ids, 10, 'g', 4, ' '));
+    ui->vdsEdit->setText(QString("%1").arg(Vds, 10, 'g', 4, ' '));
+    linkedVgSweep.clear();
+    linkedIdsSweep.clear();
+    startNextRdsCurve();
 }
 
@@ -22,12 +22,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QDateTime>
 
 #include "configuredialog.h"
+#include "gpibtransport.h"
+#include "k236reading.h"
+#include "vgstepper.h"
+#include "settlingdetector.h"
+#include "scanplanner.h"
 
-#if defined(Q_OS_LINUX)
-    #include <gpib/ib.h>
-#else
-    #include <ni4882.h>
-#endif
+#include <QMap>
+#include <QVector>
 
 
 //#define TEST_NO_INTERFACE
@@ -41,7 +43,11 @@ namespace Ui {
 
 QT_FORWARD_DECLARE_CLASS(QFile)
 QT_FORWARD_DECLARE_CLASS(Keithley236)
+QT_FORWARD_DECLARE_CLASS(GpibWorker)
+QT_FORWARD_DECLARE_CLASS(SrqDispatcher)
 QT_FORWARD_DECLARE_CLASS(Plot2D)
+QT_FORWARD_DECLARE_CLASS(RunWriter)
+struct RunJournal;
 
 
 class MainWindow : public QMainWindow
@@ -58,29 +64,49 @@ protected:
     void closeEvent(QCloseEvent *event) Q_DECL_OVERRIDE;
     void restoreSettings();
     void saveSettings();
-    void writeFileHeader();
     void startVdsSweep();
     void initPlot(QString sTitle);
     void stopMeasure();
-    bool prepareOutputFile(QString sBaseDir, QString sFileName, int currentStep);
+    void openRunOutput(int resumeStep=0);
+    bool initInstruments();
+    void restoreRunConfiguration(const RunJournal &journal, QString sBaseDir);
     bool prepareLogFile();
     void logMessage(QString sMessage);
-    bool DecodeReadings(QString sDataRead, double *current, double *voltage);
     int  criticalError(QString sWhere, QString sText, QString sInfText);
+    Keithley236* newInstrument(Addr4882_t address);
+    void deleteInstruments();
+    int  initInstrument(Keithley236 *pInstrument, int iAcquisition);
+    void sourceAndTrigger(Keithley236 *pInstrument, double dLevel, double dCompliance);
+    void sourceAndTriggerGroup(double dVg, double dVds);
+    void onRdsPointDone();
+    void startNextRdsCurve();
+    void startVgSteps(bool bReversed=false);
+    void planRdsScan();
+    void openRdsCurve();
+    void startRdsPoint();
+    void nextRdsPoint();
+    void startLinkedRdsCurve();
+    void mergeLinkedSweeps();
 
 private slots:
     void onLogMessage(QString sMessage);
+    void onWriteFailed(QString sError);
     void on_startIDSButton_clicked();
     void onIdsComplianceEvent();
     void onIgComplianceEvent();
     void onClearIdsComplianceEvent();
     void onClearIgComplianceEvent();
-    void onNewVgReading(QDateTime dataTime, QString sData);
-    void onNewRdsReading(QDateTime dataTime, QString sDataRead);
-    void onNewVgGenerated(QDateTime dataTime, QString sDataRead);
-    void onIdsSweepDone(QDateTime dataTime, QString sData);
+    void onTriggerFailed();
+    void onNewVgReading(K236Reading reading);
+    void onNewRdsReading(K236Reading reading);
+    void onNewVgGenerated(K236Reading reading);
+    void onIdsSweepChunk(K236Sweep readings);
+    void onIdsSweepDone(K236Sweep sweep);
+    void onLinkedVgSweepDone(K236Sweep sweep);
+    void onLinkedIdsSweepDone(K236Sweep sweep);
     void on_comboIds_currentIndexChanged(int indx);
     void on_startRdsButton_clicked();
+    void on_resumeButton_clicked();
 
 public:
     enum measure {
@@ -93,7 +119,10 @@ public:
 private:
     Ui::MainWindow *ui;
 
-    QFile           *pOutputFile;
+    GpibTransport   *pBus;
+    GpibWorker      *pWorker;
+    SrqDispatcher   *pSrqDispatcher;
+    RunWriter       *pRunWriter;
     QFile           *pLogFile;
     Keithley236     *pIdsEvaluator;
     Keithley236     *pVgGenerator;
@@ -115,7 +144,22 @@ private:
     double           Vds;
     double           Ids;
     int              currentStep;
-    int              nMeasure;
+    bool             bVgRead;  // The readings of the Rds point
+    bool             bIdsRead; // already received
+    K236Sweep        linkedVgSweep;
+    K236Sweep        linkedIdsSweep;
+    int              linkedCurve; // Identifies the linked curve in progress
+    VgStepper        vgStepper;
+    QMetaObject::Connection vgPipeline; // Next Vg programmed at the end of the sweep
+    bool             bNextVgProgrammed;
+    double           nextVg;
+    ScanPlanner      scanPlanner; // Order of the Rds(Vg) points
+    QVector<SettlingDetector> settling; // Of the Ids readings of each Rds curve
+    QVector<QMap<double, double> > rdsCurves; // Rds(Vg) of each curve
+    bool             bStepOpen; // The output of currentStep has been opened
+    qint64           idsTimestamp; // Of the last Ids reading (Rds mode)
+    double           passRdsSum; // Rds at the present Vg (Vg outer)
+    int              passRdsCount;
 
     QString          sLogFileName;
     QString          sLogDir;
@@ -0,0 +1,274 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "runfilesink.h"
+#include "textsink.h"
+#include "mainwindow.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+
+RunFileSink::RunFileSink()
+    : pFile(nullptr)
+    , bCompressed(false)
+    , blockStep(0)
+    , lastClosed(0)
+    , blockValue(0.0)
+    , blockStart(0)
+{
+}
+
+
+RunFileSink::~RunFileSink() {
+    delete pFile;
+}
+
+
+bool
+RunFileSink::openRun(const RunInfo &info) {
+    this->info = info;
+    bCompressed = info.bCompressed;
+    if(bCompressed) {
+        QFileInfo fileInfo(info.sFileName);
+        pFile = new QFile(QString("%1/%2.gfz").arg(info.sBaseDir, fileInfo.baseName()));
+    }
+    else
+        pFile = new QFile(QString("%1/%2").arg(info.sBaseDir, info.sFileName));
+    if(!pFile->open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+        sError = QString("Unable to Open Output File %1").arg(pFile->fileName());
+        return false;
+    }
+    if(bCompressed && !blockWriter.open(pFile, false)) {
+        sError = blockWriter.errorString();
+        return false;
+    }
+    return writeBytes(TextSink::header(info));
+}
+
+
+// A step opened again is written from scratch: its block is
+// replaced when nothing has been written after it (a repeated
+// sweep), otherwise the new block is added and indexed instead
+bool
+RunFileSink::openStep(int iStep, double stepValue) {
+    bool bLastBlock = (blockStep == 0) && !index.isEmpty() &&
+                      (index.last().step == iStep) &&
+                      (index.last().offset+index.last().size == position());
+    if(bLastBlock && !bCompressed) {
+        if(!rewind(index.last().offset))
+            return false;
+    }
+    for(int i=index.count()-1; i>=0; i--) {
+        if(index.at(i).step == iStep)
+            index.remove(i);
+    }
+    if(iStep == blockStep) { // Drop what has been written
+        if(!rewind(blockStart))
+            return false;
+        blockStep = 0;
+    }
+    heldSteps.remove(iStep);
+    if((blockStep == 0) && !bCompressed)
+        return startBlock(iStep, stepValue);
+    HeldStep &held = heldSteps[iStep];
+    held.stepValue = stepValue;
+    held.text      = stepTitle(iStep, stepValue);
+    held.bClosed   = false;
+    return true;
+}
+
+
+bool
+RunFileSink::write(int iStep, const RunPoint *pPoints, int nPoints) {
+    if(iStep == blockStep) {
+        buffer.resize(0);
+        TextSink::formatPoints(info, pPoints, nPoints, buffer);
+        return writeBytes(buffer);
+    }
+    if(!heldSteps.contains(iStep)) {
+        sError = QString("Step %1 of %2 not Open").arg(iStep).arg(pFile->fileName());
+        return false;
+    }
+    TextSink::formatPoints(info, pPoints, nPoints, heldSteps[iStep].text);
+    return true;
+}
+
+
+// The compressed blocks are written when full,
+// or when the output must reach the disk
+bool
+RunFileSink::flush(bool bSync) {
+    if(bCompressed) {
+        if(!bSync)
+            return true;
+        if(!blockWriter.flush()) {
+            sError = blockWriter.errorString();
+            return false;
+        }
+    }
+    if(!(bSync ? syncFile(pFile) : pFile->flush())) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+bool
+RunFileSink::closeStep(int iStep, bool bSync) {
+    if(iStep == blockStep) {
+        if(!endBlock() || !writeHeldSteps(false))
+            return false;
+    }
+    else if(heldSteps.contains(iStep)) {
+        heldSteps[iStep].bClosed = true;
+        lastClosed = iStep;
+        if((blockStep == 0) && !writeHeldSteps(false))
+            return false;
+    }
+    return flush(bSync);
+}
+
+
+// The steps still open are completed with what they have
+bool
+RunFileSink::closeRun() {
+    if(!pFile || !pFile->isOpen())
+        return true;
+    if((blockStep != 0) && !endBlock())
+        return false;
+    if(!writeHeldSteps(true) || !writeIndex())
+        return false;
+    if(bCompressed && !blockWriter.close()) {
+        sError = blockWriter.errorString();
+        return false;
+    }
+    if(!pFile->flush()) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    pFile->close();
+    return true;
+}
+
+
+QByteArray
+RunFileSink::stepTitle(int iStep, double stepValue) const {
+    QString sVariable = (info.iMeasure == MainWindow::Rds_vs_Vg) ? "Vds" : "Vg";
+    return QString("# Step %1 %2=%3\n").arg(iStep).arg(sVariable).arg(stepValue).toLocal8Bit();
+}
+
+
+bool
+RunFileSink::startBlock(int iStep, double stepValue) {
+    blockStep  = iStep;
+    blockValue = stepValue;
+    blockStart = position();
+    return writeBytes(stepTitle(iStep, stepValue));
+}
+
+
+// Two blank lines end a GnuPlot data set
+bool
+RunFileSink::endBlock() {
+    if(!writeBytes("\n\n"))
+        return false;
+    IndexEntry entry;
+    entry.step      = blockStep;
+    entry.stepValue = blockValue;
+    entry.offset    = blockStart;
+    entry.size      = position() - blockStart;
+    index.append(entry);
+    blockStep = 0;
+    return true;
+}
+
+
+// The held steps already closed (or all of them) become blocks.
+// Compressed, the last step closed is kept until another one is:
+// it can still be measured again (the compressed text cannot be
+// rewound)
+bool
+RunFileSink::writeHeldSteps(bool bAll) {
+    QList<int> steps = heldSteps.keys();
+    for(int i=0; i<steps.count(); i++) {
+        const HeldStep &held = heldSteps[steps.at(i)];
+        if(!held.bClosed && !bAll)
+            continue;
+        if(bCompressed && (steps.at(i) == lastClosed) && !bAll)
+            continue;
+        blockStep  = steps.at(i);
+        blockValue = held.stepValue;
+        blockStart = position();
+        if(!writeBytes(held.text) || !endBlock())
+            return false;
+        heldSteps.remove(steps.at(i));
+    }
+    return true;
+}
+
+
+bool
+RunFileSink::writeIndex() {
+    qint64 indexStart = position();
+    QString sIndex = QString("# Step_Index Step Value Offset Size\n");
+    for(int i=0; i<index.count(); i++)
+        sIndex += QString("# Step_Index %1 %2 %3 %4\n")
+                  .arg(index.at(i).step)
+                  .arg(index.at(i).stepValue, 0, 'g', 17)
+                  .arg(index.at(i).offset)
+                  .arg(index.at(i).size);
+    sIndex += QString("# Index_At %1\n").arg(indexStart, 20, 10, QChar('0'));
+    return writeBytes(sIndex.toLocal8Bit());
+}
+
+
+// The (uncompressed) file cut back to offset
+bool
+RunFileSink::rewind(qint64 offset) {
+    if(!pFile->resize(offset) || !pFile->seek(offset)) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+// Offset in the text (not in the compressed file)
+qint64
+RunFileSink::position() const {
+    return bCompressed ? blockWriter.pos() : pFile->pos();
+}
+
+
+bool
+RunFileSink::writeBytes(const QByteArray &data) {
+    if(bCompressed) {
+        if(!blockWriter.write(data)) {
+            sError = blockWriter.errorString();
+            return false;
+        }
+        return true;
+    }
+    if(pFile->write(data) != data.size()) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include "runwriter.h"
+#include "blockfile.h"
+
+#include <QMap>
+#include <QByteArray>
+
+
+// The whole run in a single text file, <name>.<ext>: the header,
+// then a block for each step, introduced by a "# Step" comment and
+// followed by two blank lines (a GnuPlot "index"). The file ends
+// with the index of the blocks ("# Step_Index step value offset
+// size" lines) and with a fixed size line, "# Index_At <20 digits
+// offset>", so that any step can be reached without scanning the file.
+// The points of a step are written as they come, unless another
+// step is being written: they are kept until they can make a
+// contiguous block (e.g. the Rds curves measured together).
+// A step measured again (a repeated sweep) replaces its block when
+// nothing has been written after it; otherwise the new block is
+// added to the file and only the new one is in the index.
+// When compressed (RunInfo::bCompressed) the same text is written to
+// <name>.gfz as a BlockFileWriter stream, whose offsets are the ones
+// of the index: each step is kept until it is complete and only the
+// blocks holding a step must be decompressed to read it.
+class RunFileSink : public RunSink
+{
+public:
+    RunFileSink();
+    ~RunFileSink();
+
+public:
+    bool openRun(const RunInfo &info);
+    bool openStep(int iStep, double stepValue);
+    bool write(int iStep, const RunPoint *pPoints, int nPoints);
+    bool flush(bool bSync);
+    bool closeStep(int iStep, bool bSync);
+    bool closeRun();
+
+public:
+    static const int indexAtSize = 32; // Size of the last line
+
+private:
+    struct IndexEntry {
+        int     step;
+        double  stepValue;
+        qint64  offset;
+        qint64  size;
+    };
+    struct HeldStep {
+        double     stepValue;
+        QByteArray text;
+        bool       bClosed;
+    };
+
+private:
+    QByteArray stepTitle(int iStep, double stepValue) const;
+    bool       startBlock(int iStep, double stepValue);
+    bool       endBlock();
+    bool       writeHeldSteps(bool bAll);
+    bool       writeIndex();
+    qint64     position() const;
+    bool       rewind(qint64 offset);
+    bool       writeBytes(const QByteArray &data);
+
+private:
+    RunInfo               info;
+    QFile                *pFile;
+    bool                  bCompressed;
+    BlockFileWriter       blockWriter;
+    int                   blockStep;  // Step being written in the file (0 = none)
+    int                   lastClosed; // Compressed: held until another step is closed
+    double                blockValue;
+    qint64                blockStart;
+    QMap<int, HeldStep>   heldSteps;  // Waiting for their turn
+    QVector<IndexEntry>   index;
+    QByteArray            buffer;
+};
@@ -0,0 +1,300 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "runwriter.h"
+
+#include <QFile>
+#include <QTimer>
+#include <QMutexLocker>
+
+#if defined(Q_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+RunSink::~RunSink() {
+}
+
+
+QString
+RunSink::errorString() const {
+    return sError;
+}
+
+
+// Flush the file down to the disk
+bool
+RunSink::syncFile(QFile *pFile) {
+    if(!pFile->flush())
+        return false;
+#if defined(Q_OS_WIN)
+    return _commit(pFile->handle()) == 0;
+#else
+    return fsync(pFile->handle()) == 0;
+#endif
+}
+
+
+// CRC-32 (IEEE 802.3) of the data, continuing a previous crc
+quint32
+RunSink::crc32(const char *pData, int nBytes, quint32 crc) {
+    static quint32 table[256] = { 0 };
+    if(table[1] == 0) {
+        for(quint32 i=0; i<256; i++) {
+            quint32 c = i;
+            for(int k=0; k<8; k++)
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for(int i=0; i<nBytes; i++)
+        crc = table[(crc ^ quint8(pData[i])) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+// The writer must not have a parent: it lives in its own thread
+RunWriter::RunWriter(QObject *parent)
+    : QObject(parent)
+    , bPosted(false)
+    , pendingStep(0)
+    , nUnflushed(0)
+{
+    policy.flushPoints    = 1;
+    policy.flushInterval  = 1000;
+    policy.bSyncAtStepEnd = false;
+    pFlushTimer = new QTimer(this);
+    connect(pFlushTimer, SIGNAL(timeout()),
+            this, SLOT(onFlushTimeout()));
+    pThread = new QThread();
+    pThread->setObjectName("RunWriter");
+    moveToThread(pThread);
+    pThread->start(QThread::LowPriority);
+}
+
+
+// The queued data are written before leaving
+RunWriter::~RunWriter() {
+    closeRun();
+    waitForWritten();
+    pThread->quit();
+    pThread->wait();
+    delete pThread;
+}
+
+
+// The sinks belong to the writer from now on
+void
+RunWriter::openRun(const RunInfo &info, const DurabilityPolicy &policy,
+                   const QList<RunSink*> &sinks)
+{
+    Command command;
+    command.kind   = Command::OpenRun;
+    command.iStep  = 0;
+    command.info   = info;
+    command.policy = policy;
+    command.sinks  = sinks;
+    post(command);
+}
+
+
+// stepValue: the Vg (Ids-Vds curves) or the Vds (Rds curves) of the step
+void
+RunWriter::openStep(int iStep, double stepValue) {
+    Command command;
+    command.kind      = Command::OpenStep;
+    command.iStep     = iStep;
+    command.stepValue = stepValue;
+    post(command);
+}
+
+
+void
+RunWriter::write(int iStep, const RunPoint &point) {
+    Command command;
+    command.kind  = Command::Write;
+    command.iStep = iStep;
+    command.points.append(point);
+    post(command);
+}
+
+
+void
+RunWriter::write(int iStep, const QVector<RunPoint> &points) {
+    Command command;
+    command.kind   = Command::Write;
+    command.iStep  = iStep;
+    command.points = points;
+    post(command);
+}
+
+
+void
+RunWriter::closeStep(int iStep) {
+    Command command;
+    command.kind  = Command::CloseStep;
+    command.iStep = iStep;
+    post(command);
+}
+
+
+// Harmless when no run is open
+void
+RunWriter::closeRun() {
+    Command command;
+    command.kind  = Command::CloseRun;
+    command.iStep = 0;
+    post(command);
+}
+
+
+// Wait until all the commands queued so far have been executed
+void
+RunWriter::waitForWritten() {
+    if(QThread::currentThread() == pThread)
+        processQueue();
+    else
+        QMetaObject::invokeMethod(this, "processQueue", Qt::BlockingQueuedConnection);
+}
+
+
+void
+RunWriter::post(const Command &command) {
+    QMutexLocker locker(&queueMutex);
+    commandQueue.enqueue(command);
+    if(!bPosted) {
+        bPosted = true;
+        QMetaObject::invokeMethod(this, "processQueue", Qt::QueuedConnection);
+    }
+}
+
+
+// All the commands queued so far are executed at once: the
+// points of consecutive writes reach the sinks together
+void
+RunWriter::processQueue() {
+    QQueue<Command> commands;
+    {
+        QMutexLocker locker(&queueMutex);
+        commands.swap(commandQueue);
+        bPosted = false;
+    }
+    while(!commands.isEmpty()) {
+        Command command = commands.dequeue();
+        execute(command);
+    }
+    writePending();
+}
+
+
+void
+RunWriter::execute(Command &command) {
+    if(command.kind == Command::Write) {
+        if(command.iStep != pendingStep)
+            writePending();
+        pendingStep = command.iStep;
+        pendingPoints += command.points;
+        return;
+    }
+    writePending();
+    if(command.kind == Command::OpenRun) {
+        closeSinks(); // The previous run was not closed
+        sinks      = command.sinks;
+        policy     = command.policy;
+        nUnflushed = 0;
+        for(int i=sinks.count()-1; i>=0; i--) {
+            if(!sinks.at(i)->openRun(command.info))
+                dropSink(i);
+        }
+        if(policy.flushInterval > 0)
+            pFlushTimer->start(policy.flushInterval);
+    }
+    else if(command.kind == Command::OpenStep) {
+        for(int i=sinks.count()-1; i>=0; i--) {
+            if(!sinks.at(i)->openStep(command.iStep, command.stepValue))
+                dropSink(i);
+        }
+    }
+    else if(command.kind == Command::CloseStep) {
+        for(int i=sinks.count()-1; i>=0; i--) {
+            if(!sinks.at(i)->closeStep(command.iStep, policy.bSyncAtStepEnd))
+                dropSink(i);
+        }
+    }
+    else if(command.kind == Command::CloseRun) {
+        closeSinks();
+    }
+}
+
+
+void
+RunWriter::writePending() {
+    if(pendingPoints.isEmpty())
+        return;
+    for(int i=sinks.count()-1; i>=0; i--) {
+        if(!sinks.at(i)->write(pendingStep, pendingPoints.constData(), pendingPoints.count()))
+            dropSink(i);
+    }
+    nUnflushed += pendingPoints.count();
+    pendingPoints.resize(0);
+    if((policy.flushPoints > 0) && (nUnflushed >= policy.flushPoints))
+        flushSinks(false);
+}
+
+
+void
+RunWriter::flushSinks(bool bSync) {
+    for(int i=sinks.count()-1; i>=0; i--) {
+        if(!sinks.at(i)->flush(bSync))
+            dropSink(i);
+    }
+    nUnflushed = 0;
+}
+
+
+void
+RunWriter::onFlushTimeout() {
+    writePending();
+    if(nUnflushed > 0)
+        flushSinks(false);
+}
+
+
+// A sink in error is dropped, the others go on
+void
+RunWriter::dropSink(int iSink) {
+    RunSink *pSink = sinks.takeAt(iSink);
+    emit writeFailed(pSink->errorString());
+    delete pSink;
+}
+
+
+void
+RunWriter::closeSinks() {
+    pFlushTimer->stop();
+    for(int i=sinks.count()-1; i>=0; i--) {
+        if(!sinks.at(i)->closeRun())
+            emit writeFailed(sinks.at(i)->errorString());
+    }
+    qDeleteAll(sinks);
+    sinks.clear();
+    nUnflushed = 0;
+}
@@ -0,0 +1,175 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QQueue>
+#include <QVector>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QMetaType>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+
+// A row of the run output
+struct RunPoint
+{
+    double  vg;
+    double  ig;
+    double  vds;
+    double  ids;
+    qint64  timestamp; // [ns] Of the Ids reading (see K236Parser::timestamp())
+    qint32  nReadings; // Needed to settle (Rds mode), 0 when not counted
+};
+Q_DECLARE_TYPEINFO(RunPoint, Q_PRIMITIVE_TYPE);
+
+
+// What is known of the run when it starts
+struct RunInfo
+{
+    QString   sBaseDir;
+    QString   sFileName;      // The step files are <name>_<step>.<ext>
+    QString   sSampleInfo;
+    int       iMeasure;       // MainWindow::measure
+    bool      bReadingsColumn;// The N_RDG column is meaningful
+    double    vdsStart;
+    double    vdsStop;
+    double    idsCompliance;
+    double    vgStart;
+    double    vgStop;
+    double    vgCompliance;
+    QDateTime startTime;
+    QStringList parameters;   // "Name=Value" of the whole configuration
+    int       resumeStep;     // Steps before it replayed from the journal (0 = new run)
+    bool      bCompressed;    // Block compressed run file and journal
+};
+
+
+// When the data written must reach the disk
+struct DurabilityPolicy
+{
+    int  flushPoints;    // Flush after so many points...
+    int  flushInterval;  // [ms] ...or after so long
+    bool bSyncAtStepEnd; // fsync() when a step is complete
+};
+
+
+// A destination of the run output (a file format).
+// The sinks are driven by the RunWriter in its own thread:
+// a false return drops the sink and errorString() tells why.
+// A step may be opened again to replace its data
+// (e.g. a sweep repeated for a range overflow).
+class RunSink
+{
+public:
+    virtual ~RunSink();
+
+public:
+    virtual bool openRun(const RunInfo &info) = 0;
+    virtual bool openStep(int iStep, double stepValue) = 0;
+    virtual bool write(int iStep, const RunPoint *pPoints, int nPoints) = 0;
+    virtual bool flush(bool bSync) = 0;
+    virtual bool closeStep(int iStep, bool bSync) = 0;
+    virtual bool closeRun() = 0;
+    QString      errorString() const;
+
+protected:
+    static bool    syncFile(QFile *pFile);
+    static quint32 crc32(const char *pData, int nBytes, quint32 crc=0);
+
+protected:
+    QString sError;
+};
+
+
+// The output stage of the measure. The readings are queued by the
+// GUI thread and formatted, written and flushed (following the
+// DurabilityPolicy) in a thread of their own, fanned out to all the
+// sinks of the run: a slow disk never delays the instruments.
+class RunWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RunWriter(QObject *parent = Q_NULLPTR);
+    ~RunWriter();
+
+public:
+    void openRun(const RunInfo &info, const DurabilityPolicy &policy,
+                 const QList<RunSink*> &sinks);
+    void openStep(int iStep, double stepValue);
+    void write(int iStep, const RunPoint &point);
+    void write(int iStep, const QVector<RunPoint> &points);
+    void closeStep(int iStep);
+    void closeRun();
+    void waitForWritten();
+
+signals:
+    void sendMessage(QString sMessage);
+    void writeFailed(QString sError);
+
+private slots:
+    void processQueue();
+    void onFlushTimeout();
+
+private:
+    struct Command {
+        enum Kind {
+            OpenRun,
+            OpenStep,
+            Write,
+            CloseStep,
+            CloseRun
+        };
+        Kind              kind;
+        int               iStep;
+        double            stepValue;
+        QVector<RunPoint> points;
+        RunInfo           info;
+        DurabilityPolicy  policy;
+        QList<RunSink*>   sinks;
+    };
+
+private:
+    void post(const Command &command);
+    void execute(Command &command);
+    void writePending();
+    void flushSinks(bool bSync);
+    void dropSink(int iSink);
+    void closeSinks();
+
+private:
+    QThread          *pThread;
+    QTimer           *pFlushTimer;
+    QMutex            queueMutex;
+    QQueue<Command>   commandQueue;
+    bool              bPosted;     // processQueue() already requested
+    // Used in the writer thread only
+    QList<RunSink*>   sinks;
+    DurabilityPolicy  policy;
+    int               pendingStep; // Points not yet handed to the sinks
+    QVector<RunPoint> pendingPoints;
+    int               nUnflushed;  // Points written since the last flush
+};
@@ -0,0 +1,102 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "scanplanner.h"
+
+#include <QtMath>
+
+
+ScanPlanner::ScanPlanner()
+    : scanOrder(VdsOuter)
+    , nPasses(0)
+    , nGiven(0)
+{
+}
+
+
+// The Vds values are vdsStart, vdsStart+vdsStep, ... inside the
+// interval. The scan starts with Vg outer.
+void
+ScanPlanner::start(double vdsStart, double vdsStop, double vdsStep) {
+    vdsValues.clear();
+    int nSteps = 0;
+    if((vdsStep != 0.0) && ((vdsStop-vdsStart)*vdsStep >= 0.0))
+        nSteps = int((vdsStop-vdsStart)/vdsStep + 1.0e-6);
+    for(int i=0; i<=nSteps; i++)
+        vdsValues.append(vdsStart + i*vdsStep);
+    scanOrder = VgOuter;
+    nPasses = 0;
+    nGiven  = 0;
+}
+
+
+// To impose the order (e.g. when the Vg steps are executed
+// by the instrument itself)
+void
+ScanPlanner::setOrder(ScanOrder order) {
+    scanOrder = order;
+}
+
+
+ScanPlanner::ScanOrder
+ScanPlanner::order() const {
+    return scanOrder;
+}
+
+
+int
+ScanPlanner::vdsCount() const {
+    return vdsValues.count();
+}
+
+
+double
+ScanPlanner::vdsAt(int i) const {
+    return vdsValues.at(i);
+}
+
+
+// The index of the next Vds value: with Vg outer false at the end
+// of the pass, with Vds outer false at the end of the scan
+bool
+ScanPlanner::nextVds(int &iVds) {
+    if(nGiven >= vdsValues.count())
+        return false;
+    if((scanOrder == VgOuter) && isReversedPass())
+        iVds = vdsValues.count()-1-nGiven;
+    else
+        iVds = nGiven;
+    nGiven++;
+    return true;
+}
+
+
+// The outer variable has changed: the inner one restarts
+// in the opposite direction
+void
+ScanPlanner::startPass() {
+    nPasses++;
+    if(scanOrder == VgOuter)
+        nGiven = 0;
+}
+
+
+bool
+ScanPlanner::isReversedPass() const {
+    return (nPasses % 2) == 0;
+}
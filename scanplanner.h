@@ -0,0 +1,57 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QtGlobal>
+#include <QVector>
+
+
+// Plans the order of the points of the Rds(Vg) measure, a scan of
+// the (Vg, Vds) plane. The gate, slow to settle, is kept in the outer
+// loop, so that it changes the fewest times, and Vds is swept
+// serpentine: its direction is reversed at every pass to avoid
+// jumping back across the whole interval. When the instrument sweeps
+// Vg itself (linked mode) Vds is the outer loop instead.
+class ScanPlanner
+{
+public:
+    enum ScanOrder {
+        VgOuter  = 0, // All the Vds values at each Vg
+        VdsOuter = 1  // A whole Rds(Vg) curve at each Vds
+    };
+
+public:
+    ScanPlanner();
+
+public:
+    void      start(double vdsStart, double vdsStop, double vdsStep);
+    void      setOrder(ScanOrder order);
+    ScanOrder order() const;
+    int       vdsCount() const;
+    double    vdsAt(int i) const;
+    bool      nextVds(int &iVds);
+    void      startPass();
+    bool      isReversedPass() const;
+
+private:
+    QVector<double> vdsValues;
+    ScanOrder scanOrder;
+    int       nPasses; // Passes of the inner variable started
+    int       nGiven;  // Vds given in the pass (VgOuter) or in the scan (VdsOuter)
+};
@@ -0,0 +1,103 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "settlingdetector.h"
+
+#include <QtMath>
+
+
+SettlingDetector::SettlingDetector()
+    : relTolerance(1.0e-3)
+    , absTolerance(0.0)
+    , maxReadings(2)
+    , x(0.0)
+    , lastValue(0.0)
+    , nReadings(0)
+    , bSettled(false)
+    , nSettled(0)
+{
+    settledX[0]     = settledX[1]     = 0.0;
+    settledValue[0] = settledValue[1] = 0.0;
+}
+
+
+void
+SettlingDetector::setTolerance(double relTolerance, double absTolerance, int maxReadings) {
+    this->relTolerance = relTolerance;
+    this->absTolerance = absTolerance;
+    this->maxReadings  = qMax(maxReadings, 1);
+}
+
+
+void
+SettlingDetector::startPoint(double x) {
+    this->x   = x;
+    nReadings = 0;
+    bSettled  = false;
+}
+
+
+// True when value can be taken as the settled reading of the point
+bool
+SettlingDetector::addReading(double value) {
+    nReadings++;
+    if(nReadings == 1) {
+        // Only close to (and beyond) the last settled points
+        if(nSettled == 2) {
+            double dx = settledX[1] - settledX[0];
+            if((dx != 0.0) && ((x-settledX[1])/dx > 0.0) && ((x-settledX[1])/dx <= 1.5)) {
+                double expected = settledValue[1] +
+                                  (settledValue[1]-settledValue[0]) * (x-settledX[1]) / dx;
+                bSettled = agree(value, expected);
+            }
+        }
+    }
+    else {
+        bSettled = agree(value, lastValue);
+    }
+    if(nReadings >= maxReadings)
+        bSettled = true;
+    lastValue = value;
+    if(bSettled) {
+        settledX[0]     = settledX[1];
+        settledValue[0] = settledValue[1];
+        settledX[1]     = x;
+        settledValue[1] = value;
+        nSettled = qMin(nSettled+1, 2);
+    }
+    return bSettled;
+}
+
+
+// Readings taken at the present point
+int
+SettlingDetector::readings() const {
+    return nReadings;
+}
+
+
+bool
+SettlingDetector::isSettled() const {
+    return bSettled;
+}
+
+
+bool
+SettlingDetector::agree(double value, double reference) const {
+    return qAbs(value-reference) <= qMax(absTolerance, relTolerance*qAbs(reference));
+}
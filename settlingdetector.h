@@ -0,0 +1,56 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QtGlobal>
+
+
+// Decides when the readings taken at a source value have settled:
+// two consecutive readings agree within the tolerance or, for the
+// first reading, the reading agrees with the value extrapolated from
+// the last two settled points (smooth, already settled regions then
+// cost a single reading). After maxReadings the last one is taken.
+// A detector follows a single curve.
+class SettlingDetector
+{
+public:
+    SettlingDetector();
+
+public:
+    void setTolerance(double relTolerance, double absTolerance, int maxReadings);
+    void startPoint(double x);
+    bool addReading(double value);
+    int  readings() const;
+    bool isSettled() const;
+
+private:
+    bool agree(double value, double reference) const;
+
+private:
+    double relTolerance;
+    double absTolerance;
+    int    maxReadings;
+    double x;            // Source value of the present point
+    double lastValue;
+    int    nReadings;    // Taken at the present point
+    bool   bSettled;
+    double settledX[2];  // The last two settled points
+    double settledValue[2];
+    int    nSettled;
+};
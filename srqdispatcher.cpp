@@ -0,0 +1,152 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "srqdispatcher.h"
+#include "gpibdevice.h"
+#include "gpibworker.h"
+
+#include <QMutexLocker>
+
+
+#define SERVICE_TIMEOUT 5000 // [ms]
+#define ERROR_WAIT      100  // [ms]
+
+
+SrqDispatcher::SrqDispatcher(int iBoard, GpibWorker *pWorker, QObject *parent)
+    : QThread(parent)
+    , pBus(GpibTransport::instance())
+    , pWorker(pWorker)
+    , gpibBoard(iBoard)
+    , bServiced(0)
+{
+    setObjectName(QString("SRQ%1").arg(gpibBoard));
+}
+
+
+SrqDispatcher::~SrqDispatcher() {
+    stop();
+}
+
+
+void
+SrqDispatcher::addDevice(GpibDevice *pDevice) {
+    QMutexLocker locker(&devicesMutex);
+    if(!devices.contains(pDevice))
+        devices.append(pDevice);
+    updateAddressList();
+}
+
+
+// Once removed the device will not be serviced any more
+void
+SrqDispatcher::removeDevice(GpibDevice *pDevice) {
+    QMutexLocker locker(&devicesMutex);
+    devices.removeAll(pDevice);
+    updateAddressList();
+}
+
+
+// Must be called with devicesMutex locked
+void
+SrqDispatcher::updateAddressList() {
+    addrList.clear();
+    for(int i=0; i<devices.count(); i++)
+        addrList.append(MakeAddr(devices.at(i)->address(), NO_SAD));
+    addrList.append(NOADDR);
+}
+
+
+void
+SrqDispatcher::stop() {
+    requestInterruption();
+    wait();
+    // Let an already posted dispatch() complete
+    pWorker->call([]() {});
+}
+
+
+void
+SrqDispatcher::run() {
+    // Wake up from time to time to check for stop requests
+    pBus->setTimeout(gpibBoard, T1s);
+    // Permits left by a dispatch() completed after a previous stop()
+    serviced.tryAcquire(serviced.available());
+    while(!isInterruptionRequested()) {
+        int iStatus = pBus->wait(gpibBoard, SRQI | TIMO);
+        if(iStatus & ERR) {
+            msleep(ERROR_WAIT);
+            continue;
+        }
+        if(!(iStatus & SRQI))
+            continue;
+        // SRQ stays asserted until the requesting device has been
+        // serial polled: wait for the service before looking again.
+        // A single dispatch() at a time is in flight, however long
+        // the acquisition thread takes to get to it
+        pWorker->post([this]() {
+            dispatch();
+            serviced.release();
+        }, GpibWorker::HighPriority);
+        while(!serviced.tryAcquire(1, SERVICE_TIMEOUT)) {
+            if(isInterruptionRequested())
+                return; // stop() lets the posted dispatch() complete
+        }
+        // SRQ still asserted by a device not known to us ?
+        if(!bServiced.loadAcquire() && (pBus->wait(gpibBoard, 0) & SRQI))
+            msleep(ERROR_WAIT);
+    }
+}
+
+
+// Executed in the acquisition thread.
+// FindRQS stops at the first device requesting service: only when
+// SRQ is still asserted afterwards (more devices requesting service)
+// all the devices are polled with AllSpoll.
+// The devices are serviced on a copy of the list: the drivers can take
+// their time (e.g. reading a sweep) without blocking addDevice() and
+// removeDevice(). They are deleted in this same thread, so none of
+// them can go away meanwhile.
+void
+SrqDispatcher::dispatch() {
+    bServiced.storeRelease(0);
+    devicesMutex.lock();
+    QList<GpibDevice*> deviceList = devices;
+    QVector<Addr4882_t> addresses = addrList;
+    devicesMutex.unlock();
+    if(deviceList.isEmpty())
+        return;
+    short statusByte;
+    pBus->findRequester(gpibBoard, addresses.constData(), &statusByte);
+    if(pBus->status() & ERR)
+        return; // ETAB: no device of ours is requesting service
+    int iDevice = int(pBus->count());
+    if((iDevice < 0) || (iDevice >= deviceList.count()))
+        return;
+    bServiced.storeRelease(1);
+    deviceList.at(iDevice)->onServiceRequest(char(statusByte));
+    if(!(pBus->wait(gpibBoard, 0) & SRQI))
+        return;
+    QVector<short> resultList(deviceList.count());
+    pBus->allSerialPoll(gpibBoard, addresses.constData(), resultList.data());
+    if(pBus->status() & ERR)
+        return;
+    for(int i=0; i<deviceList.count(); i++) {
+        if(resultList.at(i) & 64)
+            deviceList.at(i)->onServiceRequest(char(resultList.at(i)));
+    }
+}
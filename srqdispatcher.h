@@ -0,0 +1,67 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QList>
+#include <QVector>
+
+#include "gpibtransport.h"
+
+
+QT_FORWARD_DECLARE_CLASS(GpibDevice)
+QT_FORWARD_DECLARE_CLASS(GpibWorker)
+
+
+// One thread for each GPIB board waits (in ibwait) for an instrument
+// asserting SRQ, then has the devices serviced in the acquisition
+// thread of the board. No bus traffic at all until something happens.
+// The requesting device is found by FindRQS (a single bus cycle) and
+// its status byte is routed to the driver: the drivers never poll.
+class SrqDispatcher : public QThread
+{
+    Q_OBJECT
+
+public:
+    SrqDispatcher(int iBoard, GpibWorker *pWorker, QObject *parent = Q_NULLPTR);
+    ~SrqDispatcher() Q_DECL_OVERRIDE;
+
+public:
+    void addDevice(GpibDevice *pDevice);
+    void removeDevice(GpibDevice *pDevice);
+    void stop();
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+    void dispatch();
+    void updateAddressList();
+
+private:
+    GpibTransport     *pBus;
+    GpibWorker        *pWorker;
+    int                gpibBoard;
+    QMutex             devicesMutex;
+    QList<GpibDevice*> devices;
+    QVector<Addr4882_t> addrList;   // Same order of devices, NOADDR terminated
+    QSemaphore         serviced;
+    QAtomicInt         bServiced; // Written by dispatch() (acquisition thread)
+};
@@ -0,0 +1,169 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "textsink.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+
+TextSink::TextSink() {
+}
+
+
+TextSink::~TextSink() {
+    qDeleteAll(stepFiles);
+}
+
+
+bool
+TextSink::openRun(const RunInfo &info) {
+    this->info = info;
+    return true;
+}
+
+
+// A step opened again is rewritten from scratch
+bool
+TextSink::openStep(int iStep, double stepValue) {
+    Q_UNUSED(stepValue)
+    delete stepFiles.take(iStep);
+    QFile *pFile = new QFile(stepFileName(iStep));
+    if(!pFile->open(QIODevice::Text|QIODevice::WriteOnly)) {
+        sError = QString("Unable to Open Output File %1").arg(pFile->fileName());
+        delete pFile;
+        return false;
+    }
+    stepFiles.insert(iStep, pFile);
+    if(pFile->write(header(info)) < 0) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+// The lines of all the points are formatted at once
+bool
+TextSink::write(int iStep, const RunPoint *pPoints, int nPoints) {
+    QFile *pFile = stepFiles.value(iStep, nullptr);
+    if(!pFile) {
+        sError = QString("Output File of Step %1 not Open").arg(iStep);
+        return false;
+    }
+    buffer.resize(0);
+    formatPoints(info, pPoints, nPoints, buffer);
+    if(pFile->write(buffer) < 0) {
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+        return false;
+    }
+    return true;
+}
+
+
+bool
+TextSink::flush(bool bSync) {
+    QMap<int, QFile*>::const_iterator it;
+    for(it=stepFiles.constBegin(); it!=stepFiles.constEnd(); ++it) {
+        if(!(bSync ? syncFile(it.value()) : it.value()->flush())) {
+            sError = QString("Unable to Write %1").arg(it.value()->fileName());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool
+TextSink::closeStep(int iStep, bool bSync) {
+    QFile *pFile = stepFiles.take(iStep);
+    if(!pFile)
+        return true;
+    bool bDone = bSync ? syncFile(pFile) : pFile->flush();
+    if(!bDone)
+        sError = QString("Unable to Write %1").arg(pFile->fileName());
+    pFile->close();
+    delete pFile;
+    return bDone;
+}
+
+
+// The steps still open (e.g. the Rds curves measured together)
+bool
+TextSink::closeRun() {
+    bool bDone = true;
+    QList<int> steps = stepFiles.keys();
+    for(int i=0; i<steps.count(); i++)
+        bDone &= closeStep(steps.at(i), false);
+    return bDone;
+}
+
+
+QString
+TextSink::stepFileName(int iStep) const {
+    QFileInfo fileInfo(info.sFileName);
+    return QString("%1/%2_%3.%4")
+            .arg(info.sBaseDir, fileInfo.baseName())
+            .arg(iStep)
+            .arg(fileInfo.completeSuffix());
+}
+
+
+// To cope with the GnuPlot way to handle the comment lines
+QByteArray
+TextSink::header(const RunInfo &info) {
+    QString sHeader = QString("%1 %2 %3 %4")
+                      .arg("#V_G[V]", 12)
+                      .arg("I_G[A]",  12)
+                      .arg("V_DS[V]", 12)
+                      .arg("I_DS[A]", 12);
+    if(info.bReadingsColumn)
+        sHeader += QString(" %1").arg("N_RDG", 6); // Readings needed to settle
+    sHeader += "\n";
+    QStringList HeaderLines = info.sSampleInfo.split("\n");
+    for(int i=0; i<HeaderLines.count(); i++)
+        sHeader += QString("# %1\n").arg(HeaderLines.at(i));
+    sHeader += QString("# Vds_Start=%1[V] Vds_Stop=%2[V] Compliance=%3[A]\n")
+               .arg(info.vdsStart)
+               .arg(info.vdsStop)
+               .arg(info.idsCompliance);
+    sHeader += QString("# Vg_Start=%1[V] Vg_Stop=%2[V] Compliance=%3[A]\n")
+               .arg(info.vgStart)
+               .arg(info.vgStop)
+               .arg(info.vgCompliance);
+    return sHeader.toLocal8Bit();
+}
+
+
+// The lines of the points appended to buffer
+void
+TextSink::formatPoints(const RunInfo &info, const RunPoint *pPoints, int nPoints,
+                       QByteArray &buffer)
+{
+    char sLine[96];
+    for(int i=0; i<nPoints; i++) {
+        const RunPoint &point = pPoints[i];
+        int n = qsnprintf(sLine, sizeof(sLine), "%12.6g %12.6g %12.6g %12.6g",
+                          point.vg, point.ig, point.vds, point.ids);
+        if(info.bReadingsColumn)
+            qsnprintf(sLine+n, sizeof(sLine)-n, " %6d", point.nReadings);
+        buffer.append(sLine);
+        buffer.append('\n');
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include "runwriter.h"
+
+#include <QMap>
+#include <QByteArray>
+
+
+// The gnuplot friendly text output of gfet: a file for each step,
+// <name>_<step>.<ext>, with a commented header and a line of
+// space padded columns for each point
+class TextSink : public RunSink
+{
+public:
+    TextSink();
+    ~TextSink();
+
+public:
+    bool openRun(const RunInfo &info);
+    bool openStep(int iStep, double stepValue);
+    bool write(int iStep, const RunPoint *pPoints, int nPoints);
+    bool flush(bool bSync);
+    bool closeStep(int iStep, bool bSync);
+    bool closeRun();
+
+public:
+    static QByteArray header(const RunInfo &info);
+    static void       formatPoints(const RunInfo &info, const RunPoint *pPoints, int nPoints,
+                                   QByteArray &buffer);
+
+private:
+    QString    stepFileName(int iStep) const;
+
+private:
+    RunInfo           info;
+    QMap<int, QFile*> stepFiles; // The open steps
+    QByteArray        buffer;    // The formatted lines
+};
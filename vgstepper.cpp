@@ -0,0 +1,199 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "vgstepper.h"
+
+#include <QtMath>
+
+
+#define COARSE_FACTOR    4    // Adaptive: coarse step / requested step
+#define REFINE_THRESHOLD 0.02 // Relative change (or bending) worth a new point
+
+
+VgStepper::VgStepper()
+    : minStep(0.0)
+    , bAdaptive(false)
+    , maxPoints(0)
+    , nGiven(0)
+{
+}
+
+
+// Without adaptation the Vg values are exactly the ones of the
+// fixed steps: dStart, dStart+dStep, ... inside [dStart, dStop]
+void
+VgStepper::start(double dStart, double dStop, double dStep, bool bAdaptive, int maxPoints) {
+    this->bAdaptive = bAdaptive;
+    this->maxPoints = maxPoints;
+    minStep = qAbs(dStep);
+    nGiven  = 0;
+    points.clear();
+    pending.clear();
+    refined.clear();
+    double direction = (dStop >= dStart) ? 1.0 : -1.0;
+    double step = minStep;
+    if(bAdaptive)
+        step = qMax(minStep*COARSE_FACTOR, qAbs(dStop-dStart)/qMax(maxPoints/2, 2));
+    if(step <= 0.0) {
+        pending.append(dStart);
+        return;
+    }
+    int nSteps = int(qAbs(dStop-dStart)/step + 1.0e-6);
+    for(int i=0; i<=nSteps; i++)
+        pending.append(dStart + direction*i*step);
+    // The coarse pass must reach the end of the interval
+    if(bAdaptive && (qAbs(pending.last()-dStop) > 0.5*minStep))
+        pending.append(dStop);
+}
+
+
+// The next Vg to measure: false when the curve is complete
+bool
+VgStepper::nextVg(double &dVg) {
+    if(!pending.isEmpty()) {
+        dVg = pending.takeFirst();
+        nGiven++;
+        return true;
+    }
+    if(!bAdaptive || (nGiven >= maxPoints))
+        return false;
+    if(!refine(dVg))
+        return false;
+    nGiven++;
+    return true;
+}
+
+
+// The next Vg when already known (i.e. not depending on
+// the value of the present point)
+bool
+VgStepper::peekNext(double &dVg) const {
+    if(pending.isEmpty())
+        return false;
+    dVg = pending.first();
+    return true;
+}
+
+
+void
+VgStepper::addValue(double dVg, double dValue) {
+    Point point;
+    point.vg    = dVg;
+    point.value = dValue;
+    int i = points.count();
+    while((i > 0) && (points.at(i-1).vg > dVg))
+        i--;
+    points.insert(i, point);
+}
+
+
+// Number of points with a value (sorted by Vg)
+int
+VgStepper::count() const {
+    return points.count();
+}
+
+
+// Number of Vg values given so far
+int
+VgStepper::measured() const {
+    return nGiven;
+}
+
+
+double
+VgStepper::vgAt(int i) const {
+    return points.at(i).vg;
+}
+
+
+double
+VgStepper::valueAt(int i) const {
+    return points.at(i).value;
+}
+
+
+bool
+VgStepper::isAdaptive() const {
+    return bAdaptive;
+}
+
+
+// Bisect the interval with the largest change or bending of the
+// values, provided it is still wider than twice the requested step.
+// An interval is bisected only once: a Vg that got no value (e.g.
+// no current) must not be given again
+bool
+VgStepper::refine(double &dVg) {
+    if(points.count() < 2)
+        return false;
+    double vMin = points.at(0).value;
+    double vMax = vMin;
+    for(int i=1; i<points.count(); i++) {
+        vMin = qMin(vMin, points.at(i).value);
+        vMax = qMax(vMax, points.at(i).value);
+    }
+    double range = vMax - vMin;
+    if(range <= 0.0)
+        return false;
+    int    iBest = -1;
+    double bestScore = REFINE_THRESHOLD;
+    for(int i=0; i<points.count()-1; i++) {
+        if((points.at(i+1).vg - points.at(i).vg) < 2.0*minStep*(1.0-1.0e-6))
+            continue;
+        if(isRefined(0.5*(points.at(i).vg + points.at(i+1).vg)))
+            continue;
+        double score = qAbs(points.at(i+1).value - points.at(i).value) / range;
+        score = qMax(score, qMax(bending(i, range), bending(i+1, range)));
+        if(score > bestScore) {
+            bestScore = score;
+            iBest = i;
+        }
+    }
+    if(iBest < 0)
+        return false;
+    dVg = 0.5*(points.at(iBest).vg + points.at(iBest+1).vg);
+    refined.append(dVg);
+    return true;
+}
+
+
+bool
+VgStepper::isRefined(double dVg) const {
+    for(int i=0; i<refined.count(); i++) {
+        if(qAbs(refined.at(i)-dVg) <= 1.0e-6*minStep)
+            return true;
+    }
+    return false;
+}
+
+
+// Relative second difference of the values around point i
+double
+VgStepper::bending(int i, double range) const {
+    if((i < 1) || (i > points.count()-2))
+        return 0.0;
+    double h1 = points.at(i).vg - points.at(i-1).vg;
+    double h2 = points.at(i+1).vg - points.at(i).vg;
+    if((h1 <= 0.0) || (h2 <= 0.0))
+        return 0.0;
+    // Departure of the point from the chord of its neighbours
+    double chord = points.at(i-1).value +
+                   (points.at(i+1).value-points.at(i-1).value)*h1/(h1+h2);
+    return qAbs(points.at(i).value - chord) / range;
+}
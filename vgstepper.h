@@ -0,0 +1,63 @@
+/*
+ *
+Copyright (C) 2021  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#pragma once
+
+#include <QtGlobal>
+#include <QVector>
+
+
+// Chooses the Vg values of a curve. The interval is first covered
+// with uniform steps; when adaptive the steps are COARSE_FACTOR times
+// the requested one and then the intervals where R(Vg) changes most
+// (or bends most, as around the Dirac point) are bisected, down to
+// the requested step, until the point budget has been spent.
+class VgStepper
+{
+public:
+    VgStepper();
+
+public:
+    void   start(double dStart, double dStop, double dStep, bool bAdaptive, int maxPoints);
+    bool   nextVg(double &dVg);
+    bool   peekNext(double &dVg) const;
+    void   addValue(double dVg, double dValue);
+    int    count() const;
+    int    measured() const;
+    double vgAt(int i) const;
+    double valueAt(int i) const;
+    bool   isAdaptive() const;
+
+private:
+    bool   refine(double &dVg);
+    double bending(int i, double range) const;
+    bool   isRefined(double dVg) const;
+
+private:
+    struct Point {
+        double vg;
+        double value;
+    };
+    QVector<Point>  points;  // Sorted by Vg
+    QVector<double> pending; // Still to be measured (uniform pass)
+    QVector<double> refined; // Given by refine()
+    double minStep;
+    bool   bAdaptive;
+    int    maxPoints;
+    int    nGiven;           // Vg values returned by nextVg()
+};
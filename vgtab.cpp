@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "vgtab.h"
 #include "mainwindow.h"
+#include "keithley236.h"
 
 #include <QLineEdit>
 #include <QLabel>
@@ -56,6 +57,12 @@ VGTab::VGTab(QWidget *parent)
     pLayout->addWidget(&StopEdit,        2, 1, 1, 1);
     pLayout->addWidget(&WaitTimeEdit,    4, 1, 1, 1);
     pLayout->addWidget(&SweepPointsEdit, 5, 1, 1, 1);
+    pLayout->addWidget(&HardwareSyncBox, 6, 0, 1, 2);
+    pLayout->addWidget(&AdaptiveBox,     7, 0, 1, 2);
+    pLayout->addWidget(new QLabel("Max N°of Points"), 8, 0, 1, 1);
+    pLayout->addWidget(&MaxPointsEdit,   8, 1, 1, 1);
+    pLayout->addWidget(new QLabel("Acquisition"), 9, 0, 1, 1);
+    pLayout->addWidget(&AcquisitionCombo, 9, 1, 1, 1);
     // Set the Layout
     setLayout(pLayout);
 
@@ -67,6 +74,12 @@ VGTab::VGTab(QWidget *parent)
     sErrorStyle += "selection-background-color: rgb(128, 128, 255);";
     sErrorStyle += "}";
 
+    // In the order of Keithley236::AcquisitionPreset
+    AcquisitionCombo.addItem("Fast");
+    AcquisitionCombo.addItem("Balanced");
+    AcquisitionCombo.addItem("Low Noise");
+    AcquisitionCombo.addItem("Auto");
+
     connectSignals();
     restoreSettings();
     initUI();
@@ -82,6 +95,10 @@ VGTab::restoreSettings() {
     iWaitTime     = settings.value("VGTabWaitTime", 100).toInt();
     iNSweepPoints = settings.value("VGTabSweepPoints", 100).toInt();
     dInterval     = settings.value("VGTabMeasureInterval", 0.1).toDouble();
+    iAcquisition  = settings.value("VGTabAcquisition", Keithley236::LowNoiseAcquisition).toInt();
+    bHardwareSync = settings.value("VGTabHardwareSync", false).toBool();
+    bAdaptive     = settings.value("VGTabAdaptive", false).toBool();
+    iMaxPoints    = settings.value("VGTabMaxPoints", 50).toInt();
     dStep = (dStop-dStart) / iNSweepPoints;
 }
 
@@ -95,6 +112,10 @@ VGTab::saveSettings() {
     settings.setValue("VGTabWaitTime",    iWaitTime);
     settings.setValue("VGTabSweepPoints", iNSweepPoints);
     settings.setValue("VGTabMeasureInterval", dInterval);
+    settings.setValue("VGTabAcquisition", iAcquisition);
+    settings.setValue("VGTabHardwareSync", bHardwareSync);
+    settings.setValue("VGTabAdaptive",    bAdaptive);
+    settings.setValue("VGTabMaxPoints",   iMaxPoints);
 }
 
 
@@ -107,6 +128,13 @@ VGTab::setToolTips() {
     WaitTimeEdit.setToolTip(sHeader.arg(waitTimeMin).arg(waitTimeMax));
     SweepPointsEdit.setToolTip((sHeader.arg(nSweepPointsMin).arg(nSweepPointsMax)));
     MeasureIntervalEdit.setToolTip(sHeader.arg(intervalMin).arg(intervalMax));
+    AcquisitionCombo.setToolTip("Reading filter and integration time:\n"
+                                "Auto chooses them from the last readings");
+    HardwareSyncBox.setToolTip("Rds(Vg) swept by the Vg unit:\n"
+                               "its TRIGGER OUT must be connected to the TRIGGER IN of the Ids unit");
+    AdaptiveBox.setToolTip("Coarse Vg steps, then refined where R(Vg) changes most\n"
+                           "(down to the step given by the N°of Points)");
+    MaxPointsEdit.setToolTip((sHeader.arg(nSweepPointsMin).arg(nSweepPointsMax)));
 }
 
 
@@ -136,6 +164,17 @@ VGTab::initUI() {
         dInterval = intervalMin;
     }
     MeasureIntervalEdit.setText(QString("%1").arg(dInterval, 0, 'f', 2));
+    if((iAcquisition < 0) || (iAcquisition >= AcquisitionCombo.count()))
+        iAcquisition = Keithley236::LowNoiseAcquisition;
+    AcquisitionCombo.setCurrentIndex(iAcquisition);
+    HardwareSyncBox.setText("Trigger Link (Rds)");
+    HardwareSyncBox.setChecked(bHardwareSync);
+    AdaptiveBox.setText("Adaptive Vg Steps");
+    AdaptiveBox.setChecked(bAdaptive);
+    if(!isSweepPointNumberValid(iMaxPoints))
+        iMaxPoints = 50;
+    MaxPointsEdit.setText(QString("%1").arg(iMaxPoints));
+    MaxPointsEdit.setEnabled(bAdaptive);
     setToolTips();
 }
 
@@ -154,6 +193,14 @@ VGTab::connectSignals() {
             this, SLOT(onSweepPointsEdit_textChanged(const QString)));
     connect(&MeasureIntervalEdit, SIGNAL(textChanged(const QString)),
             this, SLOT(onMeasureIntervalEdit_textChanged(const QString)));
+    connect(&AcquisitionCombo, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(onAcquisitionCombo_currentIndexChanged(int)));
+    connect(&HardwareSyncBox, SIGNAL(toggled(bool)),
+            this, SLOT(onHardwareSyncBox_toggled(bool)));
+    connect(&AdaptiveBox, SIGNAL(toggled(bool)),
+            this, SLOT(onAdaptiveBox_toggled(bool)));
+    connect(&MaxPointsEdit, SIGNAL(textChanged(const QString)),
+            this, SLOT(onMaxPointsEdit_textChanged(const QString)));
 }
 
 
@@ -280,3 +327,33 @@ VGTab::onMeasureIntervalEdit_textChanged(const QString &arg1) {
 }
 
 
+void
+VGTab::onHardwareSyncBox_toggled(bool bChecked) {
+    bHardwareSync = bChecked;
+}
+
+
+void
+VGTab::onAdaptiveBox_toggled(bool bChecked) {
+    bAdaptive = bChecked;
+    MaxPointsEdit.setEnabled(bAdaptive);
+}
+
+
+void
+VGTab::onMaxPointsEdit_textChanged(const QString &arg1) {
+    int iTemp = arg1.toInt();
+    if(isSweepPointNumberValid(iTemp)) {
+        iMaxPoints = iTemp;
+        MaxPointsEdit.setStyleSheet(sNormalStyle);
+    }
+    else {
+        MaxPointsEdit.setStyleSheet(sErrorStyle);
+    }
+}
+
+
+void
+VGTab::onAcquisitionCombo_currentIndexChanged(int index) {
+    iAcquisition = index;
+}
@@ -23,6 +23,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QLineEdit>
 #include <QRadioButton>
 #include <QLabel>
+#include <QComboBox>
+#include <QCheckBox>
 
 
 class VGTab : public QWidget
@@ -42,6 +44,10 @@ public slots:
     void onWaitTimeEdit_textChanged(const QString &arg1);
     void onSweepPointsEdit_textChanged(const QString &arg1);
     void onMeasureIntervalEdit_textChanged(const QString &arg1);
+    void onAcquisitionCombo_currentIndexChanged(int index);
+    void onHardwareSyncBox_toggled(bool bChecked);
+    void onAdaptiveBox_toggled(bool bChecked);
+    void onMaxPointsEdit_textChanged(const QString &arg1);
 
 protected:
     void setToolTips();
@@ -63,6 +69,10 @@ public:
     int    iWaitTime;
     int    iNSweepPoints;
     double dInterval;
+    int    iAcquisition; // Keithley236::AcquisitionPreset
+    bool   bHardwareSync; // Rds(Vg) with the Vg unit triggering the Ids unit
+    bool   bAdaptive;     // Vg steps refined where R(Vg) changes most
+    int    iMaxPoints;    // Budget of the adaptive Vg steps
 
 private:
     // Limit Values
@@ -91,5 +101,9 @@ private:
     QLineEdit    WaitTimeEdit;
     QLineEdit    SweepPointsEdit;
     QLineEdit    MeasureIntervalEdit;
+    QComboBox    AcquisitionCombo;
+    QCheckBox    HardwareSyncBox;
+    QCheckBox    AdaptiveBox;
+    QLineEdit    MaxPointsEdit;
 };
 